@@ -15,6 +15,7 @@ gen_file() {
 network_kind = $K
 network_size = 200
 network_connectivity = $P # The meaning of this value depends on the kind of network
+network_cache = graph_cache # Generated networks are saved here and reused by other configs
 miners_percent = 0.5
 selfish_percent = $PC
 selfish_algo = $salg
@@ -35,6 +36,7 @@ transactions_per_block = 50
 seed = 1
 nthreads = -1 # -1 means find out automatically
 transaction_interval = 650 # in microseconds
+transaction_arrivals = periodic # or poisson, for a mean interval
 block_interval = 10000 # in microseconds
 block_num = 1000 
 EOF
@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# Runs tinycoin on the same network with each worker partition, and prints
+# the CPU time per message and the messages that crossed workers. Usage:
+#   partition_bench.sh [network_kind] [network_size] [network_connectivity] [block_num] [nthreads] [network_order]
+
+KIND=${1:-rmat}
+SIZE=${2:-100000}
+CONN=${3:-1000000}
+BLOCKS=${4:-20}
+THREADS=${5:--1}
+ORDER=${6:-none}
+TINYCOIN=$(dirname "$0")/../../bin/tinycoin
+CFG=$(mktemp)
+trap "rm -f $CFG" EXIT
+
+for PARTITION in none blocks ldg fennel; do
+    cat > $CFG << CFGEOF
+network_kind = $KIND
+network_size = $SIZE
+network_connectivity = $CONN
+network_order = $ORDER
+worker_partition = $PARTITION
+nthreads = $THREADS
+miners_percent = 0.5
+seed = 1
+transaction_interval = 650
+block_interval = 10000
+block_num = $BLOCKS
+CFGEOF
+    echo "$PARTITION:"
+    $TINYCOIN $CFG | grep -E "^Handled|^The worker partition|to nodes of other workers"
+done
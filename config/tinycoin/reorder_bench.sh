@@ -0,0 +1,31 @@
+#!/bin/bash
+
+# Runs tinycoin on the same network with each node order, and prints the
+# CPU time and cache misses per message. Only blocks are generated, so that
+# the number of messages does not depend on the speed of the machine: with
+# transactions, messages pile up on machines that cannot keep up. Usage:
+#   reorder_bench.sh [network_kind] [network_size] [network_connectivity] [block_num]
+
+KIND=${1:-rmat}
+SIZE=${2:-100000}
+CONN=${3:-400000}
+BLOCKS=${4:-20}
+TINYCOIN=$(dirname "$0")/../../bin/tinycoin
+CFG=$(mktemp)
+trap "rm -f $CFG" EXIT
+
+for ORDER in none degree rcm community; do
+    cat > $CFG << CFGEOF
+network_kind = $KIND
+network_size = $SIZE
+network_connectivity = $CONN
+network_order = $ORDER
+miners_percent = 0.5
+seed = 1
+transaction_interval = 1000000000
+block_interval = 10000
+block_num = $BLOCKS
+CFGEOF
+    echo -n "$ORDER: "
+    $TINYCOIN $CFG | grep "^Handled"
+done
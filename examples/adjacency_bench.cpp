@@ -0,0 +1,76 @@
+#include "cuckoo.hpp"
+#include "small_set.hpp"
+#include "common.hpp"
+#include "graph_gen.hpp"
+#include "rng.hpp"
+#include <chrono>
+#include <iostream>
+#include <malloc.h>
+
+/**
+ * Builds the adjacency of a graph with the given set type, one heap
+ * allocated set per node as in GraphHardwareManager, and reports the memory
+ * used per node, the lookups per second of random edge checks (half of
+ * which are edges of the graph) and the time to visit all the neighbours of
+ * all the nodes.
+ */
+template<typename Set>
+void measure(const char* set_name, std::size_t nodes, const edge_list_t& edges, std::size_t queries) {
+    std::size_t before = mallinfo2().uordblks;
+    std::vector<Set*> graph(nodes);
+    for (auto& adj: graph) adj = new Set;
+    for (auto [a, b]: edges) {
+        graph[a]->insert(b);
+        graph[b]->insert(a);
+    }
+    std::size_t memory = mallinfo2().uordblks - before + nodes*sizeof(Set*);
+
+    std::vector<std::pair<node_id_t, node_id_t>> lookups(queries);
+    for (auto& q: lookups) {
+        if (rng() % 2) q = edges[rng() % edges.size()];
+        else q = {rng() % nodes, rng() % nodes};
+    }
+    std::size_t found = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto [a, b]: lookups) found += graph[a]->count(b);
+    std::chrono::duration<double> lookup_time = std::chrono::high_resolution_clock::now() - start;
+
+    std::size_t visited = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for (const Set* adj: graph)
+        for (node_id_t n: *adj) visited += n;
+    std::chrono::duration<double> iteration_time = std::chrono::high_resolution_clock::now() - start;
+
+    std::cout << "\t" << set_name << "\t" << 1.0 * memory / nodes << "\t\t"
+              << queries / lookup_time.count() / 1e6 << "\t\t"
+              << iteration_time.count() * 1e9 / (2 * edges.size())
+              << "\t\t(" << found << " found, checksum " << visited % 1000 << ")" << std::endl;
+    for (Set* adj: graph) delete adj;
+}
+
+void measure_graph(const char* name, int K, std::size_t nodes, std::size_t queries) {
+    edge_list_t edges = gen_barabasi_albert(nodes, K);
+    std::vector<std::size_t> degree(nodes);
+    for (auto [a, b]: edges) {
+        degree[a]++;
+        degree[b]++;
+    }
+    std::size_t small = 0;
+    for (auto d: degree) small += d <= small_set<node_id_t>::inline_size;
+    std::cout << name << " K=" << K << ": " << nodes << " nodes, " << edges.size() << " edges, "
+              << 100.0 * small / nodes << "% of the nodes fit inline" << std::endl;
+    measure<cuckoo_hash_set<node_id_t>>("cuckoo", nodes, edges, queries);
+    measure<small_set<node_id_t>>("small", nodes, edges, queries);
+}
+
+/**
+ * Compares cuckoo_hash_set and small_set as adjacency sets of power-law
+ * graphs.
+ */
+int main(int argc, char** argv) {
+    std::size_t nodes = argc > 1 ? atoll(argv[1]) : 200000;
+    std::size_t queries = argc > 2 ? atoll(argv[2]) : 1<<22;
+    std::cout << "\tset\tbytes/node\tMlookups/s\tns/neighbour" << std::endl;
+    for (int K: {1, 2, 5})
+        measure_graph("barabasi", K, nodes, queries);
+}
@@ -1,4 +1,5 @@
 #include "chord.hpp"
+#include "churn.hpp"
 
 template<>
 std::atomic<long long> Node<std::size_t>::queued_messages{0};
@@ -7,7 +8,7 @@ std::atomic<long long> Node<std::size_t>::all_messages{0};
 
 int main(int argc, char** argv) {
     if (argc < 4) {
-        std::cerr << "Usage: " << argv[0] << " b n m" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " b n m [mean_session_ms]" << std::endl;
         return 1;
     }
     uint64_t bits = atoi(argv[1]);
@@ -15,24 +16,53 @@ int main(int argc, char** argv) {
     uint64_t messages = atoi(argv[3]);
     std::vector<std::atomic<uint64_t>> counts(bits+1);
     std::atomic<uint64_t> received_messages{0};
+    // Lookups that take more than b hops, which should only happen with
+    // churn, are counted apart so that they stand out.
+    std::atomic<uint64_t> overflow_messages{0};
+    std::atomic<uint64_t> max_hops{0};
     auto complete_callback = [&](const Node<std::size_t>* n, Message<std::size_t> msg) {
-        counts[msg.get_hops()]++;
+        uint64_t hops = msg.get_hops();
+        if (hops <= bits) counts[hops]++;
+        else overflow_messages++;
+        uint64_t prev = max_hops;
+        while (prev < hops && !max_hops.compare_exchange_weak(prev, hops));
         received_messages++;
     };
     HardwareManager<std::size_t> hwm(1<<bits, std::thread::hardware_concurrency(), 0);
+    std::vector<node_id_t> ids;
     for (unsigned i=0; i<nodes; i++) {
-        hwm.add_node<ChordNode>(hwm.gen_id(), bits, complete_callback);
+        ids.push_back(hwm.gen_id());
+        hwm.add_node<ChordNode>(ids.back(), bits, complete_callback);
         //std::cerr << "Added node " << i << std::endl;
     }
+    ChurnGenerator<std::size_t>* churn = nullptr;
+    if (argc > 4) {
+        // Every node that leaves is replaced by a new one.
+        churn = &hwm.add_generator<ChurnGenerator<std::size_t>>(
+            std::chrono::milliseconds(1),
+            exponential_sessions(std::chrono::microseconds((long long)(1000*atof(argv[4])))),
+            [&] (HardwareManager<std::size_t>& manager) {
+                node_id_t id = manager.gen_id();
+                manager.add_node<ChordNode>(id, bits, complete_callback);
+                return id;
+            }
+        );
+        for (auto id: ids) churn->track(id);
+    }
     hwm.run();
     for (unsigned i=0; i<messages; i++) {
-        hwm.gen_message(hwm.get_random_node());
+        while (true) {
+            try {
+                hwm.gen_message(hwm.get_random_node());
+                break;
+            } catch (std::exception& e) {
+                // The chosen node failed in the meantime.
+            }
+        }
         //std::cerr << "Generated message " << i << std::endl;
     }
-    while (received_messages != messages) {
-        using namespace std::literals::chrono_literals;
-        std::this_thread::sleep_for(10ms);
-    }
+    if (churn) churn->stop();
+    hwm.wait_until_idle();
     hwm.stop();
     std::cout.precision(3);
     std::cout << (long long)Node<std::size_t>::all_messages << " events processed" << std::endl;
@@ -40,4 +70,12 @@ int main(int argc, char** argv) {
         std::cout << 1.0*counts[i]/received_messages << " ";
     }
     std::cout << std::endl;
+    if (overflow_messages) {
+        std::cout << overflow_messages << " lookups took more than " << bits << " hops (up to "
+                  << max_hops << ")" << std::endl;
+    }
+    if (churn) {
+        std::cout << received_messages << " received, " << churn->failures() << " nodes failed, "
+                  << hwm.undelivered_messages() << " messages lost" << std::endl;
+    }
 }
@@ -0,0 +1,75 @@
+#include "cuckoo.hpp"
+#include "common.hpp"
+#include "graph_gen.hpp"
+#include "rng.hpp"
+#include <chrono>
+#include <iostream>
+
+/**
+ * Builds the adjacency sets of a graph, and reports the time per inserted
+ * edge and the load factor of the resulting tables.
+ */
+void measure_graph(const char* name, std::size_t nodes, const edge_list_t& edges) {
+    std::vector<cuckoo_hash_set<node_id_t>> graph(nodes);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto [a, b]: edges) {
+        graph[a].insert(b);
+        graph[b].insert(a);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    std::size_t size = 0, capacity = 0;
+    for (const auto& adj: graph) {
+        size += adj.size();
+        capacity += adj.capacity();
+    }
+    std::cout << name << "\t" << nodes << "\t" << edges.size() << "\t"
+              << elapsed.count() * 1e9 / (2 * edges.size()) << "\t\t"
+              << 1.0 * size / capacity << "\t\t" << 1.0 * capacity * sizeof(node_id_t) / size << std::endl;
+}
+
+/**
+ * Measures the lookups per second of cuckoo_hash_set<node_id_t>, with the
+ * SIMD probing selected at compile time and with the scalar one, for sets
+ * of different sizes, and with count_many. Half of the looked up keys are
+ * in the set. Then measures the cost of building the adjacency sets of some graphs.
+ */
+int main(int argc, char** argv) {
+    std::size_t queries = argc > 1 ? atoll(argv[1]) : 1<<22;
+    std::size_t graph_nodes = argc > 2 ? atoll(argv[2]) : 100000;
+    std::cout << "bucket size: " << DISTSIM_CUCKOO_BUCKET_BYTES / sizeof(node_id_t) << " keys" << std::endl;
+    std::cout << "set size\tsimd Mlookups/s\tscalar Mlookups/s\tbatched Mlookups/s\tsimd speedup" << std::endl;
+    for (std::size_t n: {2, 16, 256, 4096, 1<<16, 1<<20}) {
+        cuckoo_hash_set<node_id_t> set;
+        std::vector<node_id_t> keys;
+        for (std::size_t i=0; i<n; i++) {
+            keys.push_back(rng() % (16*n));
+            set.insert(keys.back());
+        }
+        std::vector<node_id_t> lookups(queries);
+        for (auto& q: lookups) q = rng() % 2 ? keys[rng() % n] : rng() % (16*n);
+        auto measure = [&] (auto&& count) {
+            std::size_t found = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (auto q: lookups) found += count(q);
+            std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+            return std::make_pair(queries / elapsed.count() / 1e6, found);
+        };
+        auto [simd, simd_found] = measure([&set] (node_id_t k) {return set.count(k);});
+        auto [scalar, scalar_found] = measure([&set] (node_id_t k) {return set.count_scalar(k);});
+        std::vector<uint64_t> bitmap;
+        auto start = std::chrono::high_resolution_clock::now();
+        std::size_t batched_found = set.count_many(lookups, bitmap);
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        double batched = queries / elapsed.count() / 1e6;
+        if (simd_found != scalar_found || simd_found != batched_found) {
+            std::cerr << "Mismatch between the SIMD, scalar and batched lookups!" << std::endl;
+            return 1;
+        }
+        std::cout << n << "\t\t" << simd << "\t\t" << scalar << "\t\t\t" << batched
+                  << "\t\t\t" << simd / scalar << std::endl;
+    }
+    std::cout << std::endl << "graph\tnodes\tedges\tns/insert\tload factor\tbytes/entry" << std::endl;
+    measure_graph("erdos", graph_nodes, gen_conn_erdos(graph_nodes, 10*graph_nodes));
+    measure_graph("barabasi", graph_nodes, gen_barabasi_albert(graph_nodes, 1));
+    measure_graph("barabasi", graph_nodes, gen_barabasi_albert(graph_nodes, 5));
+}
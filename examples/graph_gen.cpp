@@ -1,3 +1,5 @@
+#include "csr.hpp"
+#include "graph_file.hpp"
 #include "graph_gen.hpp"
 #include <string>
 #include <iostream>
@@ -5,26 +7,53 @@ using namespace std::literals;
 
 
 /**
- * Generates a graph and outputs it in CSV format.
+ * Generates a graph and outputs it in CSV format, or with -o in a binary
+ * graph file that can be mapped by mapped_graph.
  */
 
 int main(int argc, char** argv) {
+    const char* output = nullptr;
+    if (argc > 2 && argv[1] == "-o"s) {
+        output = argv[2];
+        argv += 2;
+        argc -= 2;
+    }
     if (argc < 4) {
-        std::cerr << "Usage: " << argv[0] << " (erdos|barabasi) N (M|K) [S]" << std::endl;;
+        std::cerr << "Usage: " << argv[0] << " [-o file] type N par [S] [rewiring | a b c]" << std::endl;
+        std::cerr << "Types are barabasi, " << generator_names << std::endl;
         return -1;
     }
     const char* type = argv[1];
-    int N = atoi(argv[2]);
-    int par = atoi(argv[3]);
-    int S = argc > 4 ? atoi(argv[4]) : 0;
-    edge_list_t edges;
-    if (type == "erdos"s) edges = gen_conn_erdos(N, par, S);
-    else if (type == "barabasi"s) edges = gen_barabasi_albert(N, par, S);
-    else {
-        std::cerr << "Unknown graph type " << type << "! Valid types are: erdos, barabasi" << std::endl;
-        return -1;
+    std::uint64_t N = atoll(argv[2]);
+    std::uint64_t par = atoll(argv[3]);
+    std::uint64_t S = argc > 4 ? atoll(argv[4]) : 0;
+    generator_options options;
+    if (type == "watts_strogatz"s && argc > 5) options.rewiring = atof(argv[5]);
+    if (type == "rmat"s && argc > 7) {
+        options.rmat_a = atof(argv[5]);
+        options.rmat_b = atof(argv[6]);
+        options.rmat_c = atof(argv[7]);
     }
-    for (auto edg: edges) {
-        std::cout << edg.first << ";" << edg.second << std::endl;
+    std::ios::sync_with_stdio(false);
+    auto print = [] (const edge_list_t& edges) {
+        for (auto edg: edges) {
+            std::cout << edg.first << ";" << edg.second << '\n';
+        }
+    };
+    if (type == "barabasi"s) {
+        edge_list_t edges = gen_barabasi_albert(N, par, S);
+        if (output) write_graph_file(output, build_csr(N, edges));
+        else print(edges);
+        return 0;
+    }
+    // Parallel generators are written out as they are generated, to handle
+    // graphs larger than memory, or streamed into CSR form.
+    bool known = with_generator(type, N, par, S, options, [&] (const auto& source) {
+        if (output) write_graph_file(output, build_csr(N, source));
+        else stream_edges(source, -1, print);
+    });
+    if (!known) {
+        std::cerr << "Unknown graph type " << type << "! Valid types are: barabasi, " << generator_names << std::endl;
+        return -1;
     }
 }
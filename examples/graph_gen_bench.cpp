@@ -0,0 +1,95 @@
+#include "csr.hpp"
+#include "edge_list_file.hpp"
+#include "graph_file.hpp"
+#include "graph_gen.hpp"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+template<typename F>
+double seconds(F&& f) {
+    auto start = std::chrono::high_resolution_clock::now();
+    f();
+    std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - start;
+    return time.count();
+}
+
+void report(const char* name, std::uint64_t edges, double t, double megabytes = 0) {
+    std::cout << "\t" << name << "\t" << edges << " edges\t" << t << " s\t"
+              << edges / t / 1e6 << " Medges/s";
+    if (megabytes) std::cout << "\t" << megabytes << " MB";
+    std::cout << std::endl;
+}
+
+void report_csr(const csr_graph<>& graph, double t) {
+    report("csr", graph.arcs() / 2, t, (graph.offsets.size() * 8 + graph.targets.size() * 4) / 1e6);
+}
+
+/**
+ * Times the generation of large random graphs, both as edge lists and
+ * streamed directly into CSR form, and reading them back from files.
+ */
+int main(int argc, char** argv) {
+    std::uint64_t N = argc > 1 ? atoll(argv[1]) : 10000000;
+    std::uint64_t M = argc > 2 ? atoll(argv[2]) : 100000000;
+    int K = argc > 3 ? atoi(argv[3]) : 5;
+    int nthreads = argc > 4 ? atoi(argv[4]) : -1;
+    edge_list_t edges;
+    csr_graph<> graph;
+
+    std::cout << "erdos N=" << N << " M=" << M << std::endl;
+    double t = seconds([&] () { edges = gen_conn_erdos(N, M, 0, nthreads); });
+    report("list", edges.size(), t);
+    edges = edge_list_t();
+    t = seconds([&] () { graph = build_csr(N, erdos_source(N, M), false, nthreads); });
+    report_csr(graph, t);
+    std::string path = "/tmp/graph_gen_bench." + std::to_string(getpid()) + ".graph";
+    t = seconds([&] () { write_graph_file(path, graph); });
+    std::uint64_t written = graph.arcs() / 2;
+    report("write", written, t);
+    graph = csr_graph<>();
+    t = seconds([&] () {
+        mapped_graph mapped(path);
+        std::uint64_t sum = 0;
+        for (std::uint64_t n=0; n<mapped.nodes(); n++) sum += mapped.degree(n);
+        if (sum != mapped.arcs()) throw std::runtime_error("Wrong degrees");
+    });
+    report("map+check", written, t);
+    unlink(path.c_str());
+    {
+        std::ofstream text(path);
+        stream_edges(erdos_source(N, M), nthreads, [&] (const edge_list_t& edges) {
+            for (auto edg: edges) text << edg.first << ";" << edg.second << '\n';
+        });
+    }
+    t = seconds([&] () { graph = import_edge_list(path, false, nthreads).graph; });
+    report("import", graph.arcs() / 2, t);
+    graph = csr_graph<>();
+    unlink(path.c_str());
+
+    std::cout << "barabasi N=" << N << " K=" << K << std::endl;
+    t = seconds([&] () { edges = gen_barabasi_albert(N, K); });
+    report("exact", edges.size(), t);
+    edges = edge_list_t();
+    t = seconds([&] () { edges = gen_barabasi_albert_parallel(N, K, 0, nthreads); });
+    report("parallel", edges.size(), t);
+    edges = edge_list_t();
+    t = seconds([&] () { graph = build_csr(N, barabasi_albert_source(N, K), false, nthreads); });
+    report_csr(graph, t);
+    graph = csr_graph<>();
+
+    std::pair<const char*, std::uint64_t> others[] = {
+        {"watts_strogatz", K}, {"regular", 2*K}, {"rmat", M}, {"geometric", 2*K}
+    };
+    for (auto [name, par]: others) {
+        std::cout << name << " N=" << N << " par=" << par << std::endl;
+        with_generator(name, N, par, 0, generator_options(), [&] (const auto& source) {
+            double t = seconds([&] () { edges = collect_edges(source, nthreads); });
+            report("list", edges.size(), t);
+            edges = edge_list_t();
+            t = seconds([&] () { graph = build_csr(N, source, false, nthreads); });
+            report_csr(graph, t);
+            graph = csr_graph<>();
+        });
+    }
+}
@@ -0,0 +1,128 @@
+#include "csr.hpp"
+#include "edge_list_file.hpp"
+#include "graph_file.hpp"
+#include "graph_gen.hpp"
+#include "graph_stats.hpp"
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <string>
+using namespace std::literals;
+
+template<typename F>
+double seconds(F&& f) {
+    auto start = std::chrono::high_resolution_clock::now();
+    f();
+    std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - start;
+    return time.count();
+}
+
+template<typename Graph>
+void print_stats(const Graph& graph, std::uint64_t samples, int rounds, int nthreads) {
+    std::uint64_t nodes = graph.nodes();
+    std::cout << "nodes\t" << nodes << "\nedges\t" << graph.arcs() / 2 << std::endl;
+
+    std::vector<std::uint64_t> histogram;
+    double t = seconds([&] () { histogram = degree_histogram(graph, nthreads); });
+    std::cout << "degree (" << t << " s)" << std::endl;
+    if (nodes) {
+        std::uint64_t min = 0;
+        while (!histogram[min]) min++;
+        std::cout << "\tmin " << min << "\tmean " << (double)graph.arcs() / nodes
+                  << "\tmax " << histogram.size() - 1 << std::endl;
+    }
+    // Degrees in [2^(i-1), 2^i), and 0 in the first bin.
+    for (std::uint64_t first=0, last=1; first<histogram.size(); first=last, last*=2) {
+        std::uint64_t count = std::accumulate(histogram.begin() + first,
+                                              histogram.begin() + std::min<std::uint64_t>(last, histogram.size()), 0ULL);
+        if (count) std::cout << "\t[" << first << ", " << last << ")\t" << count << std::endl;
+    }
+
+    std::vector<typename Graph::id_type> component;
+    t = seconds([&] () { component = connected_components(graph, nthreads); });
+    std::vector<std::uint64_t> sizes(nodes);
+    for (auto c: component) sizes[c]++;
+    std::uint64_t components = 0, largest = 0;
+    for (std::uint64_t n=0; n<nodes; n++) {
+        components += sizes[n] > 0;
+        if (sizes[n] > sizes[largest]) largest = n;
+    }
+    std::cout << "components (" << t << " s)\n\tcount " << components
+              << "\tlargest " << (nodes ? sizes[largest] : 0) << std::endl;
+
+    eccentricity_bounds ecc;
+    t = seconds([&] () { ecc = estimate_eccentricities(graph, component, (typename Graph::id_type)largest, rounds, 0, nthreads); });
+    double mean = 0;
+    for (auto e: ecc.lower) mean += e;
+    std::cout << "eccentricity in the largest component (" << t << " s, " << ecc.sources << " sources)\n"
+              << "\tdiameter in [" << ecc.diameter_lower << ", " << ecc.diameter_upper << "]"
+              << "\tmean lower bound " << (nodes ? mean / sizes[largest] : 0) << std::endl;
+
+    clustering_stats cl;
+    t = seconds([&] () { cl = clustering(graph, nthreads); });
+    std::cout << "clustering (" << t << " s)\n\ttriangles " << cl.total_triangles
+              << "\taverage " << cl.average << "\ttransitivity " << cl.transitivity << std::endl;
+
+    std::vector<double> betweenness;
+    t = seconds([&] () { betweenness = approximate_betweenness(graph, samples, 0, nthreads); });
+    std::vector<std::uint64_t> top(nodes);
+    std::iota(top.begin(), top.end(), 0);
+    std::size_t shown = std::min<std::size_t>(10, nodes);
+    std::partial_sort(top.begin(), top.begin() + shown, top.end(), [&] (std::uint64_t a, std::uint64_t b) {
+        return betweenness[a] > betweenness[b];
+    });
+    std::cout << "betweenness (" << t << " s, " << std::min(samples, nodes) << " sources)" << std::endl;
+    for (std::size_t i=0; i<shown; i++)
+        std::cout << "\tnode " << top[i] << "\tdegree " << graph.degree(top[i]) << "\t" << betweenness[top[i]] << std::endl;
+}
+
+/**
+ * Prints statistics of a graph: a binary graph file, a text edge list, or a
+ * graph generated as by graph_gen.
+ */
+int main(int argc, char** argv) {
+    std::uint64_t samples = 16;
+    int rounds = 4;
+    int nthreads = -1;
+    while (argc > 2 && argv[1][0] == '-') {
+        if (argv[1] == "-b"s) samples = atoll(argv[2]);
+        else if (argv[1] == "-r"s) rounds = atoi(argv[2]);
+        else if (argv[1] == "-t"s) nthreads = atoi(argv[2]);
+        else break;
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc != 2 && argc != 4 && argc != 5) {
+        std::cerr << "Usage: " << argv[0] << " [-b betweenness_sources] [-r eccentricity_rounds] [-t threads] file" << std::endl;
+        std::cerr << "       " << argv[0] << " [-b betweenness_sources] [-r eccentricity_rounds] [-t threads] type N par [S]" << std::endl;
+        std::cerr << "Types are barabasi, " << generator_names << std::endl;
+        return -1;
+    }
+    if (argc == 2 && is_graph_file(argv[1])) {
+        mapped_graph graph(argv[1]);
+        if (graph.directed()) {
+            std::cerr << "The graph must be undirected" << std::endl;
+            return -1;
+        }
+        print_stats(graph, samples, rounds, nthreads);
+        return 0;
+    }
+    csr_graph<> graph;
+    if (argc == 2) {
+        graph = import_edge_list(argv[1], false, nthreads).graph;
+    } else {
+        std::string type = argv[1];
+        std::uint64_t N = atoll(argv[2]);
+        std::uint64_t par = atoll(argv[3]);
+        std::uint64_t S = argc > 4 ? atoll(argv[4]) : 0;
+        if (type == "barabasi") {
+            graph = build_csr(N, gen_barabasi_albert(N, par, S), false, nthreads);
+        } else if (!with_generator(type, N, par, S, generator_options(), [&] (const auto& source) {
+            graph = build_csr(N, source, false, nthreads);
+        })) {
+            std::cerr << "Unknown graph type " << type << "! Valid types are: barabasi, " << generator_names << std::endl;
+            return -1;
+        }
+    }
+    print_stats(graph, samples, rounds, nthreads);
+}
@@ -0,0 +1,244 @@
+#include "csr.hpp"
+#include "edge_list_file.hpp"
+#include "graph_file.hpp"
+#include "graph_gen.hpp"
+#include "sharded_hwm.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace std::literals;
+
+static const int max_rumors = 64;
+
+struct rumor {
+    std::uint32_t id;
+};
+
+template<>
+std::atomic<long long> Node<rumor>::queued_messages{0};
+template<>
+std::atomic<long long> Node<rumor>::all_messages{0};
+
+/**
+ * Floods rumors: every node forwards each rumor to all its neighbours the
+ * first time it gets it.
+ */
+class FloodNode: public Node<rumor> {
+    std::atomic<std::uint64_t> seen{0};
+
+    void spread(const Message<rumor>& msg) {
+        if (seen.fetch_or(1ULL << msg.data().id) & (1ULL << msg.data().id)) return;
+        manager().iter_neighbours(id(), [&] (node_id_t n) {
+            manager().send_message(id(), n, msg);
+            return true;
+        });
+    }
+protected:
+    void start_message(Message<rumor> msg) override {
+        spread(msg);
+    }
+
+    void handle_message(Message<rumor> msg) override {
+        spread(msg);
+    }
+public:
+    FloodNode(HardwareManager<rumor>* manager, node_id_t id): Node(manager, id) {}
+
+    std::uint64_t rumors() const {
+        return seen;
+    }
+};
+
+/**
+ * What every shard reports to the parent, through shared memory.
+ */
+struct shard_result {
+    std::uint64_t reached[max_rumors];
+    std::uint64_t delivered;
+    std::uint64_t forwarded;
+    std::uint64_t undelivered;
+    double seconds;
+};
+
+/**
+ * Returns the node the given rumor starts from.
+ */
+node_id_t origin(std::uint64_t nodes, int rumor, int rumors) {
+    return (std::uint64_t)rumor * nodes / rumors;
+}
+
+template<typename Graph>
+void run_shard(shard_group<rumor>& group, int shard, const Graph& graph, int nthreads, int rumors,
+               int crash, shard_result& result) {
+    ShardedHardwareManager<rumor, Graph> hwm(group, shard, graph, nthreads, shard);
+    for (node_id_t n=hwm.first_node(); n<hwm.last_node(); n++) hwm.template add_node<FloodNode>(n);
+    for (int r=0; r<rumors; r++) {
+        node_id_t n = origin(graph.nodes(), r, rumors);
+        if (group.owner(n) == shard) hwm.gen_message(n, rumor{(std::uint32_t)r});
+    }
+    if (shard == crash) {
+        group.arrive_and_wait();
+        std::abort();
+    }
+    auto start = std::chrono::steady_clock::now();
+    bool done = hwm.run_until_quiescent();
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+    hwm.stop();
+    if (!done) return;
+    for (node_id_t n=hwm.first_node(); n<hwm.last_node(); n++) {
+        std::uint64_t seen = ((const FloodNode*)hwm.get(n))->rumors();
+        for (int r=0; r<rumors; r++) result.reached[r] += seen >> r & 1;
+    }
+    result.delivered = Node<rumor>::all_messages;
+    result.forwarded = hwm.forwarded_messages();
+    result.undelivered = hwm.undelivered_messages();
+    result.seconds = time.count();
+}
+
+/**
+ * Returns, for every rumor, the number of nodes it reaches and the number of
+ * messages it takes, computed on the graph.
+ */
+template<typename Graph>
+std::vector<std::pair<std::uint64_t, std::uint64_t>> expected_floods(const Graph& graph, int rumors) {
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> ans;
+    std::vector<bool> visited;
+    std::vector<node_id_t> queue;
+    for (int r=0; r<rumors; r++) {
+        visited.assign(graph.nodes(), false);
+        queue.assign(1, origin(graph.nodes(), r, rumors));
+        visited[queue[0]] = true;
+        std::uint64_t messages = 0;
+        for (std::size_t q=0; q<queue.size(); q++) {
+            messages += graph.degree(queue[q]);
+            for (auto t=graph.neighbours_begin(queue[q]); t!=graph.neighbours_end(queue[q]); t++) {
+                if (visited[*t]) continue;
+                visited[*t] = true;
+                queue.push_back(*t);
+            }
+        }
+        ans.emplace_back(queue.size(), messages);
+    }
+    return ans;
+}
+
+template<typename Graph>
+int run(const Graph& graph, int processes, int nthreads, int rumors, int crash) {
+    shard_group<rumor> group(processes, graph.nodes());
+    shared_memory results_memory(processes * sizeof(shard_result));
+    shard_result* results = new (results_memory.data()) shard_result[processes]();
+    auto start = std::chrono::steady_clock::now();
+    std::vector<pid_t> children;
+    for (int s=0; s<processes; s++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "Could not fork" << std::endl;
+            group.abort();
+            break;
+        }
+        if (pid == 0) {
+            try {
+                run_shard(group, s, graph, nthreads, rumors, crash, results[s]);
+            } catch (std::exception& e) {
+                std::cerr << "Shard " << s << ": " << e.what() << std::endl;
+                group.abort();
+                _exit(1);
+            }
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    // A shard that dies makes the others give up rather than wait forever.
+    bool failed = children.size() != (std::size_t)processes;
+    for (std::size_t i=0; i<children.size(); i++) {
+        int status;
+        pid_t pid = wait(&status);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            std::cerr << "Shard process " << pid << " failed" << std::endl;
+            failed = true;
+            group.abort();
+        }
+    }
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+    if (failed) return -1;
+
+    auto expected = expected_floods(graph, rumors);
+    std::uint64_t delivered = 0, forwarded = 0, undelivered = 0, expected_messages = 0;
+    bool ok = true;
+    for (int s=0; s<processes; s++) {
+        delivered += results[s].delivered;
+        forwarded += results[s].forwarded;
+        undelivered += results[s].undelivered;
+    }
+    for (int r=0; r<rumors; r++) {
+        std::uint64_t reached = 0;
+        for (int s=0; s<processes; s++) reached += results[s].reached[r];
+        ok &= reached == expected[r].first;
+        expected_messages += expected[r].second;
+    }
+    ok &= delivered == expected_messages && undelivered == 0;
+    std::cout << processes << " processes delivered " << delivered << " messages (" << forwarded
+              << " between processes) in " << time.count() << " s, " << (long long)(delivered / time.count())
+              << " messages/s." << std::endl;
+    for (int s=0; s<processes; s++)
+        std::cout << "\tshard " << s << "\t" << results[s].delivered << " messages\t" << results[s].seconds << " s" << std::endl;
+    std::cout << (ok ? "All rumors reached every node of their component." : "The floods do not match the graph!") << std::endl;
+    return ok ? 0 : -1;
+}
+
+/**
+ * Floods rumors on a graph, with the nodes split across processes that
+ * exchange messages through shared memory, and checks the result against
+ * the graph. With -c, the given shard crashes once all are ready.
+ */
+int main(int argc, char** argv) {
+    int processes = 2;
+    int nthreads = 1;
+    int rumors = 8;
+    int crash = -1;
+    while (argc > 2 && argv[1][0] == '-') {
+        if (argv[1] == "-p"s) processes = atoi(argv[2]);
+        else if (argv[1] == "-t"s) nthreads = atoi(argv[2]);
+        else if (argv[1] == "-r"s) rumors = atoi(argv[2]);
+        else if (argv[1] == "-c"s) crash = atoi(argv[2]);
+        else break;
+        argv += 2;
+        argc -= 2;
+    }
+    if ((argc != 2 && argc != 4 && argc != 5) || rumors < 1 || rumors > max_rumors || processes < 1) {
+        std::cerr << "Usage: " << argv[0] << " [-p processes] [-t threads] [-r rumors] [-c crashing_shard] file" << std::endl;
+        std::cerr << "       " << argv[0] << " [-p processes] [-t threads] [-r rumors] [-c crashing_shard] type N par [S]" << std::endl;
+        std::cerr << "Types are barabasi, " << generator_names << "; there are at most " << max_rumors << " rumors" << std::endl;
+        return -1;
+    }
+    // The graph is built before forking, so that the processes share it.
+    if (argc == 2 && is_graph_file(argv[1])) {
+        mapped_graph graph(argv[1]);
+        if (graph.directed()) {
+            std::cerr << "The graph must be undirected" << std::endl;
+            return -1;
+        }
+        return run(graph, processes, nthreads, rumors, crash);
+    }
+    csr_graph<> graph;
+    if (argc == 2) {
+        graph = import_edge_list(argv[1]).graph;
+    } else {
+        std::string type = argv[1];
+        std::uint64_t N = atoll(argv[2]);
+        std::uint64_t par = atoll(argv[3]);
+        std::uint64_t S = argc > 4 ? atoll(argv[4]) : 0;
+        if (type == "barabasi") {
+            graph = build_csr(N, gen_barabasi_albert(N, par, S));
+        } else if (!with_generator(type, N, par, S, generator_options(), [&] (const auto& source) {
+            graph = build_csr(N, source);
+        })) {
+            std::cerr << "Unknown graph type " << type << "! Valid types are: barabasi, " << generator_names << std::endl;
+            return -1;
+        }
+    }
+    return run(graph, processes, nthreads, rumors, crash);
+}
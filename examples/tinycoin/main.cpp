@@ -1,11 +1,17 @@
 #include "config.hpp"
 #include "hashpower.hpp"
 #include "tinycoin.hpp"
+#include "edge_list_file.hpp"
+#include "graph_cache.hpp"
+#include "graph_file.hpp"
 #include "graph_gen.hpp"
 #include "graph_hwm.hpp"
 #include "miner_chooser.hpp"
+#include "partitioner.hpp"
 #include "selfish.hpp"
 #include "mem_wrap.hpp"
+#include "perf_counters.hpp"
+#include "reorder.hpp"
 #include <iostream>
 #include <chrono>
 
@@ -23,6 +29,8 @@ int main(int argc, char** argv) {
     TinyBlock::delay_per_transaction = std::chrono::nanoseconds(cfg.get("delay_per_transaction", 20LL, stoll));
     TinyTransaction::delay = std::chrono::nanoseconds(cfg.get("delay_per_transaction", 20LL, stoll));
     TinyBlock::base_delay = std::chrono::nanoseconds(cfg.get("base_delay", 100LL, stoll));
+    TinyTransaction::size = cfg.get("transaction_size", 250LL, stoll);
+    TinyBlock::header_size = cfg.get("block_header_size", 80LL, stoll);
     TinyNode::block_reward = cfg.get("block_reward", 1.0, stod);
     TinyNode::transaction_reward = cfg.get("transaction_reward", 0.01, stod);
     MinerPolicy::transactions_per_block = cfg.get("transactions_per_block", 50LL, stoll);
@@ -34,19 +42,59 @@ int main(int argc, char** argv) {
     long long nthreads = cfg.get("nthreads", -1LL, stoll);
     if (nthreads == -1) nthreads = std::thread::hardware_concurrency();
     edge_list_t edges;
-    if (network_kind == "erdos"s) edges = gen_conn_erdos(network_size, network_connectivity, S);
-    else if (network_kind == "barabasi"s) edges = gen_barabasi_albert(network_size, network_connectivity, S);
+    generator_options network_options;
+    network_options.rewiring = cfg.get("network_rewiring", network_options.rewiring, stod);
+    network_options.rmat_a = cfg.get("network_rmat_a", network_options.rmat_a, stod);
+    network_options.rmat_b = cfg.get("network_rmat_b", network_options.rmat_b, stod);
+    network_options.rmat_c = cfg.get("network_rmat_c", network_options.rmat_c, stod);
+    // Generated graphs are kept in network_cache, if set, and read back by
+    // later runs with the same parameters.
+    std::string network_cache = cfg.get("network_cache", ""s, stos);
+    // A graph saved by graph_gen -o, or a text edge list. Generated graphs
+    // are kept in CSR form in network_csr if they are not cached, so that
+    // their edges are listed in the same order as those of cached graphs,
+    // and a seed gives the same run with or without the cache.
+    bool from_file = network_kind.compare(0, 5, "file:") == 0;
+    std::unique_ptr<mapped_graph> network_file;
+    csr_graph<> network_csr;
+    bool known = true;
+    if (from_file && is_graph_file(network_kind.substr(5))) {
+        network_file = std::make_unique<mapped_graph>(network_kind.substr(5));
+    }
+    else if (from_file) {
+        network_csr = import_edge_list(network_kind.substr(5), false, nthreads).graph;
+        network_size = network_csr.nodes();
+        edges = csr_edge_list(network_csr);
+    }
+    else if (!network_cache.empty()) {
+        network_file = cached_graph(network_cache, network_kind, network_size, network_connectivity, S, network_options, nthreads);
+        known = network_file != nullptr;
+    }
     else {
-        std::cerr << "Unknown graph type " << network_kind << "! Valid types are: erdos, barabasi" << std::endl;
+        known = generate_csr(network_kind, network_size, network_connectivity, S, network_options, network_csr, nthreads);
+        edges = csr_edge_list(network_csr);
+    }
+    if (!known) {
+        std::cerr << "Unknown graph type " << network_kind << "! Valid types are: file:<path>, barabasi, " << generator_names << std::endl;
         return -1;
     }
+    if (network_file) {
+        if (network_file->directed()) {
+            std::cerr << "The network must be undirected" << std::endl;
+            return -1;
+        }
+        network_size = network_file->nodes();
+        edges = csr_edge_list(*network_file);
+    }
     long long num_miners = network_size * cfg.get("miners_percent", 0.2, stod);
     double selfish_percent = cfg.get("selfish_percent", 0.0, stod);
     double selfish_power_percent = cfg.get("selfish_power_percent", selfish_percent, stod);
     long long num_selfish = num_miners * selfish_percent;
     long long num_honest = num_miners - num_selfish;
     std::string selfish_algo = cfg.get("selfish_algo", "random"s, stos);
-    auto [honest, selfish] = choose_miners(network_size, num_honest, num_selfish, edges, selfish_algo, S); 
+    // Sources sampled by the betweenness and closeness algorithms.
+    long long selfish_algo_samples = cfg.get("selfish_algo_samples", 64LL, stoll);
+    auto [honest, selfish] = choose_miners(network_size, num_honest, num_selfish, edges, selfish_algo, S, nthreads, selfish_algo_samples);
     auto [honest_powers, selfish_powers] = get_hashpower(num_honest, num_selfish, selfish_power_percent, S);
     uint64_t honest_total_power = 0;
     uint64_t selfish_total_power = 0;
@@ -63,70 +111,181 @@ int main(int argc, char** argv) {
 
     SelfishCoordinator coord;
     GraphHardwareManager<TinyData> hwm(nthreads, S);
+    // Nodes can be laid out in memory so that neighbours are close, and
+    // assigned to the workers so that most messages stay on one thread.
+    // Neither changes the ids of the nodes.
+    std::string network_order = cfg.get("network_order", "none"s, stos);
+    std::string worker_partition = cfg.get("worker_partition", "none"s, stos);
+    auto with_network = [&] (auto&& f) {
+        if (network_file) return f(*network_file);
+        if (!network_csr.nodes()) network_csr = build_csr(network_size, edges, false, nthreads);
+        return f(network_csr);
+    };
+    std::vector<node_id_t> order;
+    if (network_order != "none") {
+        order = with_network([&] (const auto& graph) {return node_order(network_order, graph, nthreads);});
+        hwm.set_node_order(order);
+    }
+    bool pin_workers = cfg.get("pin_workers", 0LL, stoll);
+    numa_topology topology;
+    if (pin_workers) {
+        topology = read_numa_topology();
+        hwm.pin_workers(topology);
+    }
+    partition_quality worker_cut;
+    if (worker_partition != "none") {
+        with_network([&] (const auto& graph) {
+            // Nodes are streamed in their new order, which keeps neighbours
+            // close if it is a breadth-first one.
+            auto part = partition_graph(worker_partition, graph, hwm.worker_count(), order);
+            worker_cut = evaluate_partition(graph, part, hwm.worker_count());
+            hwm.set_worker_assignment(std::move(part));
+        });
+    }
+    long long mailbox_capacity = cfg.get("mailbox_capacity", -1LL, stoll);
+    if (mailbox_capacity >= 0) {
+        MailboxConfig mailbox;
+        mailbox.capacity = mailbox_capacity;
+        mailbox.policy = parse_mailbox_policy(cfg.get("mailbox_policy", "tail"s, stos));
+        mailbox.red_threshold = cfg.get("mailbox_red_threshold", mailbox_capacity/2, stoll);
+        mailbox.backpressure_timeout = std::chrono::microseconds(cfg.get("mailbox_backpressure_timeout", 1000LL, stoll));
+        hwm.set_mailbox(mailbox);
+    }
     std::vector<uint64_t> miner_weights_ps;
     for (long long i=0; i<network_size; i++) {
         if (honest.count(i)) {
-            auto pwr = honest_powers.back();
+            miner_weights_ps.push_back(honest_powers.back());
             honest_powers.pop_back();
-            hwm.add_node<TinyMiner>(pwr, (MinerPolicy*) NULL);
-            miner_weights_ps.push_back(pwr);
         } else if (selfish.count(i)) {
-            auto pwr = selfish_powers.back();
+            miner_weights_ps.push_back(selfish_powers.back());
             selfish_powers.pop_back();
-            hwm.add_node<TinyMiner>(pwr, (SelfishPolicy*) NULL, &coord);
-            miner_weights_ps.push_back(pwr);
         } else {
-            hwm.add_node<TinyNode>();
             miner_weights_ps.push_back(0);
         }
     }
+    // With pinned workers, the nodes of every worker are created on its
+    // NUMA node, by several threads at once: the coordinator of the selfish
+    // miners locks its list of members.
+    hwm.add_nodes(network_size, [&] (node_id_t i) -> std::unique_ptr<Node<TinyData>> {
+        if (honest.count(i)) return std::make_unique<TinyMiner>(&hwm, i, miner_weights_ps[i], (MinerPolicy*) NULL);
+        if (selfish.count(i)) return std::make_unique<TinyMiner>(&hwm, i, miner_weights_ps[i], (SelfishPolicy*) NULL, &coord);
+        return std::make_unique<TinyNode>(&hwm, i);
+    });
     for (unsigned i=1; i<miner_weights_ps.size(); i++) {
         miner_weights_ps[i] += miner_weights_ps[i-1];
     }
-    for (auto edg: edges) hwm.add_edge(edg.first, edg.second);
-    hwm.run();
+    auto link_latency = std::chrono::nanoseconds(cfg.get("link_latency", 0LL, stoll));
+    auto link_latency_max = std::chrono::nanoseconds(cfg.get("link_latency_max", (long long)link_latency.count(), stoll));
+    auto link = LinkParams::make(
+        link_latency,
+        std::chrono::nanoseconds(cfg.get("link_jitter", 0LL, stoll)),
+        cfg.get("link_bandwidth", 0.0, stod),
+        cfg.get("link_loss", 0.0, stod),
+        parse_jitter_distribution(cfg.get("link_jitter_distribution", "uniform"s, stos))
+    );
+    if (!link.ideal()) hwm.set_default_link(link);
+    if (network_file && link_latency_max <= link_latency) hwm.add_graph(*network_file);
+    else if (network_csr.nodes() && link_latency_max <= link_latency) hwm.add_graph(network_csr);
+    else if (link_latency_max > link_latency) {
+        // Every edge gets its own latency.
+        std::vector<LinkParams> links;
+        links.reserve(edges.size());
+        for (std::size_t i=0; i<edges.size(); i++) {
+            link.latency_ns = rng(link_latency.count(), link_latency_max.count()+1);
+            links.push_back(link);
+        }
+        hwm.add_edges(edges, links);
+    }
+    else for (auto edg: edges) hwm.add_edge(edg.first, edg.second);
 
     auto transaction_interval = std::chrono::microseconds(cfg.get("transaction_interval", 1000LL, stoll));
     auto block_interval = std::chrono::microseconds(cfg.get("block_interval", 10000LL, stoll));
-    auto final_wait = std::chrono::microseconds(cfg.get("final_wait", 10000LL, stoll));
     const auto block_num = cfg.get("block_num", 1000LL, stoll);
-    auto last_block = std::chrono::high_resolution_clock::now();
-    std::atomic<long long> tx_done = 0;
-    std::atomic<long long> blocks_done = 0;
+    auto& blocks = hwm.add_generator<PeriodicGenerator<TinyData>>(
+        block_interval, weighted_nodes<TinyData>(miner_weights_ps), TinyData{TinyBlock()}, block_num
+    );
+    // Transactions arrive every transaction_interval, or, with
+    // transaction_arrivals=poisson, with exponential inter-arrival times of
+    // that mean.
+    std::string transaction_arrivals = cfg.get("transaction_arrivals", "periodic"s, stos);
+    EventGenerator<TinyData>* transaction_generator;
+    if (transaction_arrivals == "periodic") {
+        transaction_generator = &hwm.add_generator<PeriodicGenerator<TinyData>>(
+            transaction_interval, uniform_nodes<TinyData>(), TinyData{TinyTransaction()}
+        );
+    } else if (transaction_arrivals == "poisson") {
+        transaction_generator = &hwm.add_generator<PoissonGenerator<TinyData>>(
+            transaction_interval, uniform_nodes<TinyData>(), TinyData{TinyTransaction()}
+        );
+    } else {
+        std::cerr << "Unknown transaction arrivals " << transaction_arrivals << "! Valid ones are: periodic, poisson" << std::endl;
+        return -1;
+    }
+    auto& transactions = *transaction_generator;
+    std::atomic<bool> finished = false;
     std::thread status_thread([&]() {
-        while (Node<TinyData>::queued_messages || blocks_done < block_num) {
+        auto print_status = [&](char end) {
             printf(
-                "% 9lld/% 9lld blocks, %12lld transactions, % 12lld/% 12lld events left\r",
-                (long long)blocks_done, block_num, (long long)tx_done,
-                (long long)Node<TinyData>::queued_messages, (long long)Node<TinyData>::all_messages
+                "% 9lld/% 9lld blocks, %12lld transactions, % 12lld/% 12lld events left%c",
+                (long long)blocks.fired(), block_num, (long long)transactions.fired(),
+                (long long)Node<TinyData>::queued_messages, (long long)Node<TinyData>::all_messages, end
             );
             fflush(stdout);
+        };
+        while (!finished) {
+            print_status('\r');
             std::this_thread::sleep_for(100ms);
         }
-        printf(
-            "% 9lld/% 9lld blocks, %12lld transactions, % 12lld/% 12lld events left\n",
-            (long long)blocks_done, block_num, (long long)tx_done,
-            (long long)Node<TinyData>::queued_messages, (long long)Node<TinyData>::all_messages
-        );
+        print_status('\n');
     });
-    for (; blocks_done < block_num;) {
-        auto now = std::chrono::high_resolution_clock::now();
-        if (now > last_block + block_interval) {
-            int miner = rng.choose_weighted(miner_weights_ps);
-            hwm.gen_message(miner, TinyData{TinyBlock()});
-            last_block = now;
-            blocks_done++;
+    // Optionally split the network in two for a while, without stopping it.
+    long long partition_start = cfg.get("partition_start", -1LL, stoll);
+    auto partition_duration = std::chrono::microseconds(cfg.get("partition_duration", 100000LL, stoll));
+    double partition_fraction = cfg.get("partition_fraction", 0.5, stod);
+    // Edges removed by the partition; 0 also means that there was no
+    // partition, because it was disabled or the run ended before it.
+    std::size_t partition_edges = 0;
+    std::thread partition_thread([&]() {
+        if (partition_start < 0) return;
+        // partition_start counts from the start of the workers, and the
+        // network can only be split concurrently once the manager runs.
+        while (!hwm.is_running()) {
+            if (finished) return;
+            std::this_thread::sleep_for(10us);
         }
-        int tx_origin = hwm.get_random_node();
-        hwm.gen_message(tx_origin, TinyData{TinyTransaction()});
-        std::this_thread::sleep_for(transaction_interval);
-        tx_done++;
-    }
+        std::this_thread::sleep_for(std::chrono::microseconds(partition_start));
+        if (finished) return;
+        auto cut = hwm.partition([&](node_id_t n) {return n < partition_fraction * network_size;});
+        partition_edges = cut.size();
+        std::this_thread::sleep_for(partition_duration);
+        hwm.heal(cut);
+    });
+    // Worker threads are counted, as they are started by run_until.
+    auto cache_misses = perf_counter::cache_misses();
+    double cpu_start = process_cpu_seconds();
+    long long messages_start = Node<TinyData>::all_messages;
+    hwm.run_until([&]() {return blocks.done();});
+    transactions.stop();
     coord.flush_chain();
+    hwm.wait_until_idle();
+    finished = true;
     status_thread.join();
+    partition_thread.join();
     hwm.stop();
+    double cpu_time = process_cpu_seconds() - cpu_start;
+    long long messages = Node<TinyData>::all_messages - messages_start;
 
-    auto [blockchain, head] = ((TinyNode*)hwm.get(0))->get_blockchain();
+    auto [known_blocks, head] = ((TinyNode*)hwm.get(0))->get_blockchain();
+    // Parents have smaller ids than their children, so the blocks are
+    // visited by id.
+    std::size_t max_id = 0;
+    known_blocks.for_each([&max_id] (std::size_t id, const TinyBlock&) {
+        max_id = std::max(max_id, id);
+    });
+    std::vector<TinyBlock> blockchain(max_id+1);
+    known_blocks.for_each([&blockchain] (std::size_t id, const TinyBlock& blk) {
+        if (id != 0) blockchain[id] = blk;
+    });
     std::vector<std::size_t> split_num(blockchain.size(), 0);
     std::vector<std::size_t> split_len(blockchain.size(), 0);
     std::vector<bool> main_chain(blockchain.size(), false);
@@ -138,7 +297,6 @@ int main(int argc, char** argv) {
     std::size_t total_splits = 0;
     std::size_t max_split_len = 0;
     for (auto blk: blockchain) {
-        if (blk.id == 0) continue;
         if (blk.id == (std::size_t)-1) continue;
         if (honest.count(blk.miner) && main_chain[blk.id]) honest_blocks++;
         else if (selfish.count(blk.miner) && main_chain[blk.id]) selfish_blocks++;
@@ -158,6 +316,32 @@ int main(int argc, char** argv) {
                 max_split_len = split_len[blk.id];
         }
     }
+    std::cout << hwm.dropped_messages() << " messages were dropped because of full mailboxes." << std::endl;
+    std::cout << hwm.blocked_messages() << " messages had to wait for space in a mailbox." << std::endl;
+    if (partition_start >= 0) {
+        std::cout << "The partition removed " << partition_edges << " edges, and " <<
+            hwm.severed_messages() << " messages were sent on removed edges." << std::endl;
+    }
+    std::cout << "Handled " << messages << " messages in " << cpu_time << " s of CPU time (" <<
+        (long long)(messages / cpu_time) << " messages/s), with ";
+    if (cache_misses.available()) std::cout << 1.0 * cache_misses.read() / messages << " cache misses per message." << std::endl;
+    else std::cout << "n/a cache misses (no hardware counters)." << std::endl;
+    if (worker_partition != "none") {
+        auto traffic = hwm.traffic();
+        std::cout << "The worker partition cuts " << 100 * worker_cut.cut_ratio << "% of the edges, with " <<
+            worker_cut.imbalance << " times the average number of nodes in the largest part." << std::endl;
+        std::cout << traffic.local_sends << " messages were sent to nodes of the same worker and " <<
+            traffic.remote_sends << " to nodes of other workers, and " << traffic.stolen << " nodes were stolen." << std::endl;
+    }
+    if (pin_workers) {
+        auto traffic = hwm.traffic();
+        std::set<int> numa_nodes;
+        for (int w=0; w<hwm.worker_count(); w++) numa_nodes.insert(hwm.worker_numa_node(w));
+        std::cout << "Workers were pinned to " << std::min<std::size_t>(hwm.worker_count(), topology.cpu_count()) <<
+            " CPUs on " << numa_nodes.size() << " NUMA nodes; " << traffic.cross_numa_sends <<
+            " messages were sent to nodes on other NUMA nodes, and " << traffic.cross_numa_stolen <<
+            " nodes were stolen from them." << std::endl;
+    }
     std::cout << "There were " << total_splits << " blockchain splits." << std::endl;
     std::cout << "The longest split lasted for " << max_split_len << " blocks." << std::endl;
     std::cout << "Honest miners have mined " << honest_blocks << " real blocks." << std::endl;
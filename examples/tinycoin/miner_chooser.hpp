@@ -1,27 +1,61 @@
 #ifndef TINYCOIN_MINER_HPP
 #define TINYCOIN_MINER_HPP
+#include <algorithm>
+#include <numeric>
 #include <set>
+#include "csr.hpp"
 #include "graph_gen.hpp"
+#include "graph_stats.hpp"
 #include "rng.hpp"
 
-auto choose_miners(int N, int num_honest, int num_selfish, const edge_list_t& edges, std::string algo, uint64_t seed) {
+/**
+ * Returns the num_selfish nodes with the highest scores, breaking ties in
+ * favour of higher ids, sorted by id.
+ */
+template<typename Score>
+std::vector<uint64_t> highest_scores(const std::vector<Score>& score, int num_selfish) {
+    std::vector<uint64_t> nodes(score.size());
+    std::iota(nodes.begin(), nodes.end(), 0);
+    std::partial_sort(nodes.begin(), nodes.begin() + num_selfish, nodes.end(), [&] (uint64_t a, uint64_t b) {
+        return score[a] > score[b] || (score[a] == score[b] && a > b);
+    });
+    nodes.resize(num_selfish);
+    std::sort(nodes.begin(), nodes.end());
+    return nodes;
+}
+
+/**
+ * Chooses the honest and the selfish miners. Selfish miners are placed at
+ * random, or on the nodes with the highest degree, (sampled) betweenness or
+ * closeness centrality, or core number (ties broken by degree).
+ */
+auto choose_miners(int N, int num_honest, int num_selfish, const edge_list_t& edges, std::string algo, uint64_t seed,
+                   int nthreads = -1, uint64_t samples = 64) {
     std::vector<uint64_t> selfish;
     std::vector<uint64_t> honest;
     if (algo == "random") {
         selfish = rng.get_distinct(num_selfish, N);
-    } else if (algo == "highdegree") {
-        std::vector<std::pair<uint64_t, uint64_t>> degree(N, {0, 0});
-        for (auto edg: edges) {
-            degree[edg.first].first++;
-            degree[edg.second].first++;
+    } else if (algo == "highdegree" || algo == "betweenness" || algo == "closeness" || algo == "kcore") {
+        csr_graph<> graph = build_csr(N, edges, false, nthreads);
+        if (algo == "highdegree") {
+            std::vector<uint64_t> degree(N);
+            for (int i=0; i<N; i++) degree[i] = graph.degree(i);
+            selfish = highest_scores(degree, num_selfish);
+        } else if (algo == "betweenness") {
+            selfish = highest_scores(approximate_betweenness(graph, samples, seed, nthreads), num_selfish);
+        } else if (algo == "closeness") {
+            selfish = highest_scores(approximate_closeness(graph, samples, seed, nthreads), num_selfish);
+        } else {
+            std::vector<uint32_t> core = core_numbers(graph, nthreads);
+            std::vector<std::pair<uint32_t, uint64_t>> score(N);
+            for (int i=0; i<N; i++) score[i] = {core[i], graph.degree(i)};
+            selfish = highest_scores(score, num_selfish);
         }
-        for (int i=0; i<N; i++) degree[i].second = i;
-        std::sort(degree.begin(), degree.end(), std::greater<std::pair<uint64_t, uint64_t>>());
-        for (int i=0; i<num_selfish; i++) selfish.push_back(degree[i].second);
     } else {
-        std::cerr << "Unknown algorithm " << algo << "! Valid types are: random, highdegree" << std::endl;
+        std::cerr << "Unknown algorithm " << algo << "! Valid types are: random, highdegree, betweenness, closeness, kcore" << std::endl;
         exit(-1);
     }
+    // get_distinct needs the excluded nodes sorted.
     honest = rng.get_distinct(num_honest, N, selfish);
     return std::make_pair(std::set<uint64_t>(honest.begin(), honest.end()), std::set<uint64_t>(selfish.begin(), selfish.end()));
 }
@@ -1,13 +1,16 @@
 #ifndef TINYCOIN_SELFISH_HPP
 #define TINYCOIN_SELFISH_HPP
 #include "tinycoin.hpp"
+#include "concurrent_cuckoo.hpp"
 
 class SelfishPolicy;
 
 class SelfishCoordinator: public TinyMiner {
     std::deque<TinyBlock> our_chain;
     std::map<node_id_t, SelfishPolicy*> members;
-    std::set<std::size_t> blocks_seen;
+    // Members can be created concurrently, by add_nodes with pinned workers.
+    std::mutex members_mutex;
+    concurrent_cuckoo_hash_set<std::size_t> blocks_seen;
     std::size_t starting_height = 0;
     std::size_t published_blocks = 0;
     std::size_t our_head = 0;
@@ -18,7 +21,7 @@ class SelfishCoordinator: public TinyMiner {
         our_chain.clear();
         published_blocks = 0;
         our_head = head;
-        starting_height = lengths[head];
+        starting_height = lengths.at(head);
         private_pending_transactions = pending_transactions;
     }
     void add_block(const TinyBlock& blk) {
@@ -34,9 +37,11 @@ class SelfishCoordinator: public TinyMiner {
 public:
     virtual void forward(Message<TinyData>) override {}
     void add_member(node_id_t id, SelfishPolicy* ptr) {
+        std::lock_guard<std::mutex> lck(members_mutex);
         members.emplace(id, ptr);
     }
     bool is_member(node_id_t id) {
+        std::lock_guard<std::mutex> lck(members_mutex);
         return members.count(id);
     }
     std::size_t get_head() {return our_head;}
@@ -57,23 +62,23 @@ public:
 
     void others_block(const TinyBlock& blk) {
         handle_block(blk);
+        // Every member sees every block, but only the first one to see it
+        // has to take the lock.
+        if (is_member(blk.miner) || !blocks_seen.insert(blk.id)) return;
         std::vector<TinyBlock> to_send;
         {
             std::lock_guard<std::mutex> lck(m);
-            if (is_member(blk.miner)) return;
-            if (blocks_seen.count(blk.id)) return;
-            blocks_seen.insert(blk.id);
             // If the block is not the new head, ignore it.
             if (blk.id != head) return;
-            if (starting_height + our_chain.size() + published_blocks < lengths[blk.id]) {
+            if (starting_height + our_chain.size() + published_blocks < lengths.at(blk.id)) {
                 // If the others have more blocks, give up and clear our branch
                 clear_chain();
-            } else if (starting_height + our_chain.size() + published_blocks == lengths[blk.id]) {
+            } else if (starting_height + our_chain.size() + published_blocks == lengths.at(blk.id)) {
                 // If the branches are now tied, publish the private block and hope for the best.
                 to_send.push_back(our_chain.front());
                 our_chain.pop_front();
                 published_blocks++;
-            } else if (starting_height + our_chain.size() + published_blocks == lengths[blk.id] + 1) {
+            } else if (starting_height + our_chain.size() + published_blocks == lengths.at(blk.id) + 1) {
                 // We have a lead of 1, do not waste it.
                 flush_chain_(to_send);
             } else {
@@ -92,7 +97,7 @@ public:
             add_block(blk);
             // If the chains were tied and our branch was at least 1 long
             if (
-                (starting_height + our_chain.size() + published_blocks == lengths[head] + 1)
+                (starting_height + our_chain.size() + published_blocks == lengths.at(head) + 1)
                 && published_blocks + our_chain.size() > 1
             ) { // We won the "tie race": send all the blocks left and clear our branch.
                 flush_chain_(to_send);
@@ -132,8 +137,8 @@ public:
     SelfishPolicy(
         const std::vector<TinyTransaction>& transactions,
         const std::set<std::size_t>& private_pending_transactions,
-        const std::vector<TinyBlock>& blockchain,
-        const std::vector<std::size_t>& lengths,
+        const cuckoo_hash_map<std::size_t, TinyBlock>& blockchain,
+        const cuckoo_hash_map<std::size_t, std::size_t>& lengths,
         const std::size_t& head,
         const std::size_t id,
         const std::function<void(TinyBlock)> send_block,
@@ -1,8 +1,10 @@
 #include "tinycoin.hpp"
 
 std::chrono::nanoseconds TinyTransaction::delay;
+std::size_t TinyTransaction::size;
 std::chrono::nanoseconds TinyBlock::delay_per_transaction;
 std::chrono::nanoseconds TinyBlock::base_delay;
+std::size_t TinyBlock::header_size;
 double TinyNode::block_reward;
 double TinyNode::transaction_reward;
 std::size_t MinerPolicy::transactions_per_block;
@@ -0,0 +1,153 @@
+#ifndef DISTSIM_CHURN_HPP
+#define DISTSIM_CHURN_HPP
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <vector>
+#include "generator.hpp"
+#include "rng.hpp"
+
+/**
+ * Draws the length of a node's session, i.e. the time between its join and
+ * its failure.
+ */
+typedef std::function<std::chrono::nanoseconds()> session_length_t;
+
+namespace churn_detail {
+    /**
+     * Returns a random number in (0, 1].
+     */
+    inline double uniform() {
+        return ((rng() >> 11) + 1) * 0x1.0p-53;
+    }
+}
+
+/**
+ * Exponentially distributed sessions with the given mean.
+ */
+template<typename D>
+session_length_t exponential_sessions(const D& mean) {
+    double m = std::chrono::duration_cast<std::chrono::nanoseconds>(mean).count();
+    return [m] () {
+        return std::chrono::nanoseconds((long long)(-std::log(churn_detail::uniform()) * m));
+    };
+}
+
+/**
+ * Pareto distributed sessions with the given shape and minimum length.
+ * Measured P2P session lengths are heavy-tailed, with shapes close to 1.
+ */
+template<typename D>
+session_length_t pareto_sessions(double shape, const D& minimum) {
+    double m = std::chrono::duration_cast<std::chrono::nanoseconds>(minimum).count();
+    return [shape, m] () {
+        return std::chrono::nanoseconds((long long)(m / std::pow(churn_detail::uniform(), 1.0 / shape)));
+    };
+}
+
+/**
+ * Weibull distributed sessions with the given shape and scale.
+ */
+template<typename D>
+session_length_t weibull_sessions(double shape, const D& scale) {
+    double s = std::chrono::duration_cast<std::chrono::nanoseconds>(scale).count();
+    return [shape, s] () {
+        return std::chrono::nanoseconds((long long)(s * std::pow(-std::log(churn_detail::uniform()), 1.0 / shape)));
+    };
+}
+
+/**
+ * Steady-state churn: every node leaves when its session ends, and is
+ * immediately replaced by a new node with a fresh session, so that the
+ * size of the network stays constant. Joins and failures happen while the
+ * workers keep handling messages.
+ *
+ * The generator checks for expired sessions every resolution; nodes that
+ * are not created through join (e.g. the initial ones) are given a session
+ * with track. If join throws duplicate_node_error, because a node was added
+ * concurrently with the id it chose, it is called again.
+ */
+template <typename T>
+class ChurnGenerator: public EventGenerator<T> {
+public:
+    /**
+     * Adds a new node to the manager and returns its id.
+     */
+    typedef std::function<node_id_t(HardwareManager<T>&)> join_t;
+private:
+    typedef std::pair<long long, node_id_t> session_end_t;
+    const std::chrono::nanoseconds resolution;
+    const session_length_t session_length;
+    const join_t join;
+    const std::chrono::steady_clock::time_point start;
+    std::priority_queue<session_end_t, std::vector<session_end_t>, std::greater<session_end_t>> sessions;
+    std::mutex sessions_mutex;
+    std::atomic<std::uint64_t> joins_{0};
+    std::atomic<std::uint64_t> failures_{0};
+
+    long long now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+protected:
+    std::chrono::nanoseconds next_interval() override {
+        return resolution;
+    }
+
+    void fire(HardwareManager<T>& manager) override {
+        std::lock_guard<std::mutex> lck(sessions_mutex);
+        long long t = now();
+        while (!sessions.empty() && sessions.top().first <= t) {
+            node_id_t node = sessions.top().second;
+            sessions.pop();
+            try {
+                manager.fail(node);
+                failures_++;
+            } catch (std::exception& e) {
+                // Someone else made it fail already.
+            }
+            node_id_t id;
+            while (true) {
+                try {
+                    id = join(manager);
+                    break;
+                } catch (duplicate_node_error& e) {
+                    // Another thread took the id join chose; try again.
+                }
+            }
+            joins_++;
+            sessions.emplace(t + session_length().count(), id);
+        }
+    }
+public:
+    template<typename D>
+    ChurnGenerator(const D& resolution, session_length_t session_length, join_t join):
+        resolution(std::chrono::duration_cast<std::chrono::nanoseconds>(resolution)),
+        session_length(std::move(session_length)), join(std::move(join)),
+        start(std::chrono::steady_clock::now()) {}
+
+    /**
+     * Starts a session for a node that is already in the network.
+     */
+    void track(node_id_t node) {
+        std::lock_guard<std::mutex> lck(sessions_mutex);
+        sessions.emplace(now() + session_length().count(), node);
+    }
+
+    /**
+     * Returns the number of nodes that joined the network so far.
+     */
+    std::uint64_t joins() const {
+        return joins_;
+    }
+
+    /**
+     * Returns the number of nodes that failed so far.
+     */
+    std::uint64_t failures() const {
+        return failures_;
+    }
+};
+
+#endif
@@ -3,6 +3,7 @@
 #include <cstddef>
 #include <vector>
 #include <functional>
+#include <stdexcept>
 
 template <typename T>
 class Node;
@@ -13,8 +14,21 @@ class Message;
 template <typename T>
 class HardwareManager;
 
+template <typename T>
+class EventGenerator;
+
 typedef std::size_t node_id_t;
 
+/**
+ * Thrown when adding a node whose id is already taken, which can happen
+ * when another thread adds a node between the choice of an id and its
+ * insertion.
+ */
+class duplicate_node_error: public std::runtime_error {
+public:
+    duplicate_node_error(): std::runtime_error("Duplicate node id") {}
+};
+
 template<typename T>
 bool satisfies(const std::vector<T>& vec, std::size_t pos, const std::function<bool(const T& v)>& f) {
     return vec.size() > pos && f(vec[pos]);
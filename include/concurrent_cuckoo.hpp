@@ -0,0 +1,300 @@
+#ifndef DISTSIM_CONCURRENT_CUCKOO_HPP
+#define DISTSIM_CONCURRENT_CUCKOO_HPP
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "cuckoo.hpp"
+
+/**
+ * A cuckoo hash set that can be used by many threads at once, with the
+ * table layout and probing of cuckoo_hash_set.
+ *
+ * Lookups take no locks: every bucket has a version counter, which is odd
+ * while the bucket is being written, and a lookup retries if the versions
+ * of its two buckets changed while it compared them. Buckets share a fixed
+ * array of counters, small enough to stay in cache. Inserts and erases
+ * lock the stripes of the key's two buckets. An insert that finds both
+ * buckets full locks every stripe, looks for a path of keys that can move
+ * to their other bucket and moves them starting from the free end, so that
+ * a key is always in at least one of its buckets. Growing the table also
+ * locks every stripe; old tables are kept until the set is destroyed, as
+ * lookups may still be reading them, and together take less memory than
+ * the current one.
+ */
+template<typename T, T missing = (T)-1, int bucket_size = DISTSIM_CUCKOO_BUCKET_BYTES/sizeof(T)>
+class concurrent_cuckoo_hash_set {
+    static_assert(std::is_integral<T>::value, "concurrent_cuckoo_hash_set keys must be integers");
+public:
+    typedef T value_type;
+    typedef size_t size_type;
+private:
+    struct table_t {
+        size_t mask;
+        T* keys;
+        table_t(size_t mask): mask(mask), keys(cuckoo_detail::allocate<T, missing, bucket_size>(mask)) {}
+        ~table_t() {
+            free(keys);
+        }
+    };
+
+    static const int lock_stripes = 64;
+    // A multiple of lock_stripes, so that buckets sharing a counter are
+    // always written under the same lock.
+    static const int version_count = 4096;
+    std::atomic<table_t*> table;
+    std::atomic<size_t> sz{0};
+    float max_load;
+    std::mutex stripes[lock_stripes];
+    std::vector<table_t*> old_tables;
+    std::atomic<uint32_t> versions[version_count] = {};
+
+    static size_t stripe(size_t bucket) {
+        return bucket % lock_stripes;
+    }
+
+    /**
+     * Writes k in a slot, making the version of its bucket odd meanwhile.
+     */
+    void write(table_t* t, size_t slot, T k) {
+        std::atomic<uint32_t>& version = versions[slot / bucket_size % version_count];
+        uint32_t v = version.load(std::memory_order_relaxed);
+        version.store(v+1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        __atomic_store_n(&t->keys[slot], k, __ATOMIC_RELAXED);
+        version.store(v+2, std::memory_order_release);
+    }
+
+    /**
+     * Returns the slot of k in bucket h1 or h2 of t, or -1. The caller must
+     * hold the stripes of both buckets.
+     */
+    static size_t find_locked(const table_t* t, const T& k, size_t h1, size_t h2) {
+        unsigned bits = cuckoo_detail::match<T, bucket_size>(t->keys, k, h1, h2);
+        return bits ? cuckoo_detail::matched_slot<bucket_size>(bits, h1, h2) : -1;
+    }
+
+    static size_t free_slot(const table_t* t, size_t h) {
+        for (int pos=0; pos<bucket_size; pos++)
+            if (t->keys[h*bucket_size+pos] == missing) return h*bucket_size+pos;
+        return -1;
+    }
+
+    bool full(const table_t* t) const {
+        return sz+1 > max_load*(t->mask+1)*bucket_size;
+    }
+
+    class stripe_lock {
+        std::mutex* a;
+        std::mutex* b;
+    public:
+        stripe_lock(concurrent_cuckoo_hash_set& set, size_t h1, size_t h2) {
+            size_t s1 = std::min(stripe(h1), stripe(h2));
+            size_t s2 = std::max(stripe(h1), stripe(h2));
+            a = &set.stripes[s1];
+            b = s1 == s2 ? nullptr : &set.stripes[s2];
+            a->lock();
+            if (b) b->lock();
+        }
+        ~stripe_lock() {
+            if (b) b->unlock();
+            a->unlock();
+        }
+    };
+
+    class all_stripes_lock {
+        concurrent_cuckoo_hash_set& set;
+    public:
+        all_stripes_lock(concurrent_cuckoo_hash_set& set): set(set) {
+            for (auto& m: set.stripes) m.lock();
+        }
+        ~all_stripes_lock() {
+            for (int i=lock_stripes-1; i>=0; i--) set.stripes[i].unlock();
+        }
+    };
+
+    /**
+     * Looks for a sequence of slots, starting from one of k's buckets, such
+     * that the key in each slot can move to the next one, and the last one
+     * is free. Returns false if there is none within max_kicks moves.
+     */
+    static bool find_path(const table_t* t, const T& k, std::vector<size_t>& path) {
+        path.clear();
+        size_t hash = cuckoo_detail::hash_1(k, t->mask);
+        for (int i=0; i<cuckoo_detail::max_kicks; i++) {
+            size_t slot = free_slot(t, hash);
+            if (slot != (size_t)-1) {
+                path.push_back(slot);
+                return true;
+            }
+            slot = hash*bucket_size + i % bucket_size;
+            // A path that goes through the same slot twice would move the
+            // wrong key the second time.
+            if (std::find(path.begin(), path.end(), slot) != path.end()) return false;
+            path.push_back(slot);
+            T moved = t->keys[slot];
+            size_t c1 = cuckoo_detail::hash_1(moved, t->mask);
+            hash = hash == c1 ? cuckoo_detail::hash_2(moved, t->mask) : c1;
+        }
+        return false;
+    }
+
+    /**
+     * Moves every key to a table with (at least) the given mask. All the
+     * stripes must be locked.
+     */
+    void grow(size_t new_mask) {
+        table_t* old = table.load(std::memory_order_relaxed);
+        while (true) {
+            table_t* t = new table_t(new_mask);
+            bool ok = true;
+            for (size_t i=0; ok && i<(old->mask+1)*bucket_size; i++) {
+                T k = old->keys[i];
+                if (k == missing) continue;
+                ok = cuckoo_detail::place<T, missing, bucket_size>(k, t->keys, new_mask, [] (size_t) {});
+            }
+            if (ok) {
+                table.store(t, std::memory_order_release);
+                old_tables.push_back(old);
+                return;
+            }
+            delete t;
+            new_mask = 2*new_mask+1;
+        }
+    }
+
+    /**
+     * Inserts k when both its buckets are full or the table must grow.
+     */
+    bool insert_slow(const T& k) {
+        all_stripes_lock lck(*this);
+        std::vector<size_t> path;
+        while (true) {
+            table_t* t = table.load(std::memory_order_relaxed);
+            size_t h1 = cuckoo_detail::hash_1(k, t->mask);
+            size_t h2 = cuckoo_detail::hash_2(k, t->mask);
+            if (find_locked(t, k, h1, h2) != (size_t)-1) return false;
+            if (!full(t)) {
+                size_t slot = free_slot(t, h2);
+                if (slot != (size_t)-1 || find_path(t, k, path)) {
+                    if (slot != (size_t)-1) {
+                        write(t, slot, k);
+                    } else {
+                        for (size_t i=path.size()-1; i>0; i--)
+                            write(t, path[i], t->keys[path[i-1]]);
+                        write(t, path[0], k);
+                    }
+                    sz++;
+                    return true;
+                }
+            }
+            grow(2*t->mask+1);
+        }
+    }
+public:
+    concurrent_cuckoo_hash_set(const concurrent_cuckoo_hash_set&) = delete;
+    concurrent_cuckoo_hash_set& operator=(const concurrent_cuckoo_hash_set&) = delete;
+
+    concurrent_cuckoo_hash_set(): table(new table_t(0)), max_load(bucket_size >= 4 ? 0.9 : 0.85) {}
+
+    ~concurrent_cuckoo_hash_set() {
+        delete table.load();
+        for (table_t* t: old_tables) delete t;
+    }
+
+    bool count(const T& k) const {
+        const table_t* t = table.load(std::memory_order_acquire);
+        while (true) {
+            size_t h1 = cuckoo_detail::hash_1(k, t->mask);
+            size_t h2 = cuckoo_detail::hash_2(k, t->mask);
+            uint32_t v1 = versions[h1 % version_count].load(std::memory_order_acquire);
+            uint32_t v2 = versions[h2 % version_count].load(std::memory_order_acquire);
+            if (((v1 | v2) & 1) == 0) {
+                bool found = cuckoo_detail::match<T, bucket_size>(t->keys, k, h1, h2) != 0;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (versions[h1 % version_count].load(std::memory_order_relaxed) == v1 &&
+                    versions[h2 % version_count].load(std::memory_order_relaxed) == v2 &&
+                    table.load(std::memory_order_relaxed) == t)
+                    return found;
+            }
+            t = table.load(std::memory_order_acquire);
+        }
+    }
+
+    /**
+     * Inserts k. Returns false if it was already in the set.
+     */
+    bool insert(const T& k) {
+        {
+            table_t* t = table.load(std::memory_order_acquire);
+            size_t h1 = cuckoo_detail::hash_1(k, t->mask);
+            size_t h2 = cuckoo_detail::hash_2(k, t->mask);
+            stripe_lock lck(*this, h1, h2);
+            if (table.load(std::memory_order_relaxed) == t && !full(t)) {
+                if (find_locked(t, k, h1, h2) != (size_t)-1) return false;
+                size_t slot = free_slot(t, h1);
+                if (slot == (size_t)-1) slot = free_slot(t, h2);
+                if (slot != (size_t)-1) {
+                    write(t, slot, k);
+                    sz++;
+                    return true;
+                }
+            }
+        }
+        return insert_slow(k);
+    }
+
+    /**
+     * Removes k. Returns false if it was not in the set.
+     */
+    bool erase(const T& k) {
+        while (true) {
+            table_t* t = table.load(std::memory_order_acquire);
+            size_t h1 = cuckoo_detail::hash_1(k, t->mask);
+            size_t h2 = cuckoo_detail::hash_2(k, t->mask);
+            stripe_lock lck(*this, h1, h2);
+            if (table.load(std::memory_order_relaxed) != t) continue;
+            size_t slot = find_locked(t, k, h1, h2);
+            if (slot == (size_t)-1) return false;
+            write(t, slot, missing);
+            sz--;
+            return true;
+        }
+    }
+
+    /**
+     * Calls f on every key. Changes to the set wait until it returns.
+     */
+    template<typename F>
+    void for_each(F&& f) {
+        all_stripes_lock lck(*this);
+        const table_t* t = table.load(std::memory_order_relaxed);
+        for (size_t i=0; i<(t->mask+1)*bucket_size; i++)
+            if (t->keys[i] != missing) f(t->keys[i]);
+    }
+
+    /**
+     * Grows the table so that it can hold n keys without exceeding the
+     * maximum load factor.
+     */
+    void reserve(size_type n) {
+        all_stripes_lock lck(*this);
+        size_t mask = table.load(std::memory_order_relaxed)->mask;
+        size_t new_mask = mask;
+        while (n > max_load*(new_mask+1)*bucket_size) new_mask = 2*new_mask+1;
+        if (new_mask != mask) grow(new_mask);
+    }
+
+    size_type size() const {
+        return sz;
+    }
+    size_type capacity() const {
+        return (table.load()->mask+1)*bucket_size;
+    }
+    float load_factor() const {
+        return 1.0f * sz / capacity();
+    }
+    bool empty() const {
+        return sz == 0;
+    }
+};
+#endif
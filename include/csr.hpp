@@ -0,0 +1,181 @@
+#ifndef DISTSIM_CSR_HPP
+#define DISTSIM_CSR_HPP
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "graph_gen.hpp"
+#include "parallel.hpp"
+
+/**
+ * A graph in compressed sparse row form: the neighbours of node n are
+ * targets[offsets[n]] up to targets[offsets[n+1]] (exclusive), in increasing
+ * order. Undirected graphs store each edge in both directions.
+ */
+template<typename Id = std::uint32_t>
+struct csr_graph {
+    typedef Id id_type;
+    std::vector<std::uint64_t> offsets;
+    std::vector<Id> targets;
+
+    std::uint64_t nodes() const {
+        return offsets.empty() ? 0 : offsets.size() - 1;
+    }
+    /**
+     * Returns the number of stored (directed) edges.
+     */
+    std::uint64_t arcs() const {
+        return targets.size();
+    }
+    std::uint64_t degree(std::uint64_t n) const {
+        return offsets[n+1] - offsets[n];
+    }
+    const Id* neighbours_begin(std::uint64_t n) const {
+        return targets.data() + offsets[n];
+    }
+    const Id* neighbours_end(std::uint64_t n) const {
+        return targets.data() + offsets[n+1];
+    }
+};
+
+/**
+ * Returns the edges of a graph in CSR form (csr_graph or mapped_graph) as a
+ * list. Edges of undirected graphs are listed once, with the larger endpoint
+ * first.
+ */
+template<typename Graph>
+edge_list_t csr_edge_list(const Graph& graph, bool directed=false) {
+    edge_list_t ans;
+    ans.reserve(directed ? graph.arcs() : graph.arcs() / 2);
+    for (std::uint64_t n=0; n<graph.nodes(); n++)
+        for (auto t=graph.neighbours_begin(n); t!=graph.neighbours_end(n); t++)
+            if (directed || *t < n) ans.emplace_back(n, *t);
+    return ans;
+}
+
+/**
+ * Splits an edge list in chunks, to be used wherever a generator such as
+ * erdos_source is expected.
+ */
+class edge_list_source {
+    const edge_list_t& edges;
+public:
+    static constexpr std::uint64_t chunk_size = 1<<18;
+    edge_list_source(const edge_list_t& edges): edges(edges) {}
+    std::size_t chunks() const {
+        return (edges.size() + chunk_size - 1) / chunk_size;
+    }
+    template<typename F>
+    void chunk(std::size_t c, F&& emit) const {
+        std::uint64_t last = std::min<std::uint64_t>(edges.size(), (c+1)*chunk_size);
+        for (std::uint64_t i=c*chunk_size; i<last; i++) emit(edges[i].first, edges[i].second);
+    }
+};
+
+/**
+ * Builds the CSR form of the graph with the given number of nodes and the
+ * edges produced by source, which must have the chunks() and chunk(c, emit)
+ * methods of erdos_source. Unless dedupe is true, it must not produce the
+ * same edge twice (in either direction, if the graph is undirected).
+ *
+ * The edges are never stored as a list: chunks are generated once to count
+ * the degrees and once more to fill the targets, on nthreads threads (-1
+ * means one per core), so the source must produce the same edges every time.
+ */
+template<typename Id = std::uint32_t, typename Source>
+csr_graph<Id> build_csr(std::uint64_t nodes, const Source& source, bool directed=false, int nthreads=-1, bool dedupe=false) {
+    if (nodes > (std::uint64_t)std::numeric_limits<Id>::max()+1)
+        throw std::runtime_error("Too many nodes for the id type");
+    std::unique_ptr<std::atomic<std::uint64_t>[]> pos(new std::atomic<std::uint64_t>[nodes]());
+    auto check = [nodes] (std::uint64_t a, std::uint64_t b) {
+        if (a >= nodes || b >= nodes) throw std::runtime_error("Edge endpoint out of range");
+    };
+    // Sources often produce the edges of a node together (erdos_source
+    // produces those of each node to the nodes before it), so the first
+    // endpoint of consecutive edges is updated once per run of edges.
+    parallel_for(source.chunks(), nthreads, [&] (std::uint64_t c) {
+        std::uint64_t run_node = 0, run_length = 0;
+        source.chunk(c, [&] (std::uint64_t a, std::uint64_t b) {
+            check(a, b);
+            if (a != run_node) {
+                if (run_length) pos[run_node].fetch_add(run_length, std::memory_order_relaxed);
+                run_node = a;
+                run_length = 0;
+            }
+            run_length++;
+            if (!directed) pos[b].fetch_add(1, std::memory_order_relaxed);
+        });
+        if (run_length) pos[run_node].fetch_add(run_length, std::memory_order_relaxed);
+    });
+
+    csr_graph<Id> ans;
+    ans.offsets.resize(nodes+1);
+    for (std::uint64_t n=0; n<nodes; n++) {
+        ans.offsets[n+1] = ans.offsets[n] + pos[n].load(std::memory_order_relaxed);
+        pos[n].store(ans.offsets[n], std::memory_order_relaxed);
+    }
+    ans.targets.resize(ans.offsets[nodes]);
+
+    parallel_for(source.chunks(), nthreads, [&] (std::uint64_t c) {
+        std::uint64_t run_node = 0;
+        std::vector<Id> run;
+        std::vector<std::pair<std::uint64_t, Id>> reversed;
+        auto flush = [&] () {
+            if (run.empty()) return;
+            std::uint64_t first = pos[run_node].fetch_add(run.size(), std::memory_order_relaxed);
+            std::copy(run.begin(), run.end(), ans.targets.begin() + first);
+            run.clear();
+        };
+        source.chunk(c, [&] (std::uint64_t a, std::uint64_t b) {
+            if (a != run_node) {
+                flush();
+                run_node = a;
+            }
+            run.push_back(b);
+            if (!directed) reversed.emplace_back(b, a);
+        });
+        flush();
+        // Positions are all taken before writing, as a store to memory that
+        // is not in cache would delay every following atomic operation.
+        for (auto& [b, a]: reversed) b = pos[b].fetch_add(1, std::memory_order_relaxed);
+        for (auto [p, a]: reversed) ans.targets[p] = a;
+    });
+    if (!dedupe) pos.reset();
+
+    // Threads fill each adjacency in an arbitrary order. With dedupe, pos
+    // is set to the end of each adjacency without repetitions.
+    parallel_for_ranges(nodes, 1<<14, nthreads, [&] (std::uint64_t first, std::uint64_t last) {
+        for (std::uint64_t n=first; n<last; n++) {
+            auto begin = ans.targets.begin() + ans.offsets[n], end = ans.targets.begin() + ans.offsets[n+1];
+            std::sort(begin, end);
+            if (dedupe) pos[n].store(std::unique(begin, end) - ans.targets.begin(), std::memory_order_relaxed);
+        }
+    });
+    if (dedupe) {
+        // Adjacencies only move towards the start, so they can be moved in
+        // order in place.
+        std::uint64_t size = 0;
+        for (std::uint64_t n=0; n<nodes; n++) {
+            std::uint64_t begin = ans.offsets[n], end = pos[n].load(std::memory_order_relaxed);
+            std::copy(ans.targets.begin() + begin, ans.targets.begin() + end, ans.targets.begin() + size);
+            ans.offsets[n] = size;
+            size += end - begin;
+        }
+        ans.offsets[nodes] = size;
+        ans.targets.resize(size);
+        ans.targets.shrink_to_fit();
+    }
+    return ans;
+}
+
+/**
+ * Builds the CSR form of a graph given as an edge list.
+ */
+template<typename Id = std::uint32_t>
+csr_graph<Id> build_csr(std::uint64_t nodes, const edge_list_t& edges, bool directed=false, int nthreads=-1, bool dedupe=false) {
+    return build_csr<Id>(nodes, edge_list_source(edges), directed, nthreads, dedupe);
+}
+#endif
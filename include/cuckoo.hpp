@@ -1,12 +1,210 @@
 #ifndef DISTSIM_CUCKOO_HPP
 #define DISTSIM_CUCKOO_HPP
+#include <algorithm>
+#include <new>
 #include <vector>
+#include <type_traits>
 #include <assert.h>
 #include <immintrin.h>
 #include <stdlib.h>
 #include <stdint.h>
 
-template<typename T, T missing = -1, int bucket_size = 16/sizeof(T)>
+// Size of a bucket, in bytes. Lookups compare both candidate buckets of a
+// key at once, so with AVX-512 the buckets can be twice as wide as with
+// SSE/AVX2 for the same cost.
+#ifndef DISTSIM_CUCKOO_BUCKET_BYTES
+#ifdef __AVX512F__
+#define DISTSIM_CUCKOO_BUCKET_BYTES 32
+#else
+#define DISTSIM_CUCKOO_BUCKET_BYTES 16
+#endif
+#endif
+
+/**
+ * Table layout, hashing and probing shared by cuckoo_hash_set and
+ * cuckoo_hash_map. A table with mask m has m+1 buckets of bucket_size keys,
+ * followed by the stash: keys that found no place in the table live there
+ * until the next rehash. Small tables, which are rehashed cheaply, have no
+ * stash.
+ */
+namespace cuckoo_detail {
+    static const int max_kicks = 64;
+
+    // Multiplicative hashing: the key is multiplied by a large odd constant,
+    // and the top bits of the product select the bucket, so that sequential
+    // keys are spread across the whole table.
+    template<typename T>
+    size_t hash(const T& k, uint64_t multiplier, size_t mask) {
+        unsigned bits = __builtin_popcountll(mask);
+        if (bits == 0) return 0;
+        return (uint64_t)k * multiplier >> (64 - bits);
+    }
+
+    template<typename T>
+    size_t hash_1(const T& k, size_t mask) {
+        return hash(k, 0x9E3779B97F4A7C15ULL, mask);
+    }
+
+    template<typename T>
+    size_t hash_2(const T& k, size_t mask) {
+        return hash(k, 0xC2B2AE3D27D4EB4FULL, mask);
+    }
+
+    template<int bucket_size>
+    size_t stash_capacity(size_t mask) {
+        return mask < 3 ? 0 : bucket_size;
+    }
+
+    template<int bucket_size>
+    size_t slots(size_t mask) {
+        return (mask+1)*bucket_size + stash_capacity<bucket_size>(mask);
+    }
+
+    template<typename T, T missing, int bucket_size>
+    T* allocate(size_t mask) {
+        T* table = nullptr;
+        if (posix_memalign((void**)&table, sizeof(T)*bucket_size, sizeof(T)*slots<bucket_size>(mask)))
+            throw std::bad_alloc();
+        std::fill(table, table+slots<bucket_size>(mask), missing);
+        return table;
+    }
+
+    /**
+     * Compares k with the keys in buckets h1 and h2. Bit i of the result is
+     * set if slot i of bucket h1 holds k, bit bucket_size+i if slot i of
+     * bucket h2 does.
+     */
+    template<typename T, int bucket_size>
+    unsigned match_scalar(const T* ht, const T& k, size_t h1, size_t h2) {
+        unsigned result = 0;
+        for (unsigned i=0; i<bucket_size; i++) {
+            result |= (unsigned)(ht[(bucket_size*h1)|i] == k) << i;
+            result |= (unsigned)(ht[(bucket_size*h2)|i] == k) << (bucket_size+i);
+        }
+        return result;
+    }
+
+    /**
+     * Same as match_scalar, with SIMD instructions when the keys and the
+     * buckets allow it.
+     */
+    template<typename T, int bucket_size>
+    unsigned match(const T* ht, const T& k, size_t h1, size_t h2) {
+        constexpr bool simd_key = std::is_integral<T>::value && (sizeof(T) == 4 || sizeof(T) == 8);
+        if constexpr (simd_key && sizeof(T)*bucket_size == 16) {
+#ifdef __AVX2__
+            // Both buckets in a single 256-bit register.
+            __m256i b = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_load_si128((__m128i*)&ht[bucket_size*h1])),
+                _mm_load_si128((__m128i*)&ht[bucket_size*h2]), 1
+            );
+            if constexpr (sizeof(T) == 8)
+                return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(b, _mm256_set1_epi64x(k))));
+            else
+                return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(b, _mm256_set1_epi32(k))));
+#else
+            if constexpr (sizeof(T) == 4) {
+                __m128i cmp = _mm_set1_epi32(k);
+                __m128i b1 = _mm_load_si128((__m128i*)&ht[bucket_size*h1]);
+                __m128i b2 = _mm_load_si128((__m128i*)&ht[bucket_size*h2]);
+                return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(cmp, b1))) |
+                    _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(cmp, b2))) << 4;
+            }
+#endif
+        }
+        if constexpr (simd_key && sizeof(T)*bucket_size == 32) {
+#if defined(__AVX512F__)
+            // Both buckets in a single 512-bit register, each broadcast into
+            // its half under a mask: gcc's _mm512_inserti64x4 and
+            // _mm512_zextsi256_si512 pass an undefined register through.
+            __m512i b = _mm512_mask_broadcast_i64x4(
+                _mm512_maskz_broadcast_i64x4(0x0F, _mm256_load_si256((__m256i*)&ht[bucket_size*h1])),
+                0xF0, _mm256_load_si256((__m256i*)&ht[bucket_size*h2])
+            );
+            if constexpr (sizeof(T) == 8)
+                return _mm512_cmpeq_epi64_mask(b, _mm512_set1_epi64(k));
+            else
+                return _mm512_cmpeq_epi32_mask(b, _mm512_set1_epi32(k));
+#elif defined(__AVX2__)
+            __m256i b1 = _mm256_load_si256((__m256i*)&ht[bucket_size*h1]);
+            __m256i b2 = _mm256_load_si256((__m256i*)&ht[bucket_size*h2]);
+            if constexpr (sizeof(T) == 8) {
+                __m256i cmp = _mm256_set1_epi64x(k);
+                return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(cmp, b1))) |
+                    _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(cmp, b2))) << 4;
+            } else {
+                __m256i cmp = _mm256_set1_epi32(k);
+                return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(cmp, b1))) |
+                    _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(cmp, b2))) << 8;
+            }
+#endif
+        }
+        return match_scalar<T, bucket_size>(ht, k, h1, h2);
+    }
+
+    /**
+     * Converts a non-zero result of match into the index of a slot.
+     */
+    template<int bucket_size>
+    size_t matched_slot(unsigned bits, size_t h1, size_t h2) {
+        unsigned i = __builtin_ctz(bits);
+        return i < bucket_size ? h1*bucket_size+i : h2*bucket_size+i-bucket_size;
+    }
+
+    /**
+     * Returns the slot of the stash that holds k, or -1.
+     */
+    template<typename T, int bucket_size>
+    size_t find_in_stash(const T* ht, size_t mask, uint32_t stash_size, const T& k) {
+        for (size_t i=0; i<stash_size; i++)
+            if (ht[(mask+1)*bucket_size+i] == k)
+                return (mask+1)*bucket_size+i;
+        return -1;
+    }
+
+    /**
+     * Places k in one of its buckets, moving other keys to their alternative
+     * bucket if needed. Every time a key is written to a slot, moved(slot)
+     * is called, so that data associated with the keys can follow them. If
+     * no place is found after max_kicks moves, returns false, with k set to
+     * the key that was left out.
+     */
+    template<typename T, T missing, int bucket_size, typename F>
+    bool place(T& k, T* table, size_t mask, F&& moved) {
+        size_t h1 = hash_1(k, mask);
+        for (int pos=0; pos<bucket_size; pos++)
+            if (table[h1*bucket_size+pos] == missing) {
+                table[h1*bucket_size+pos] = std::move(k);
+                moved(h1*bucket_size+pos);
+                return true;
+            }
+        size_t h2 = hash_2(k, mask);
+        for (int pos=0; pos<bucket_size; pos++)
+            if (table[h2*bucket_size+pos] == missing) {
+                table[h2*bucket_size+pos] = std::move(k);
+                moved(h2*bucket_size+pos);
+                return true;
+            }
+        size_t hash = h1;
+        for (int i=0; i<max_kicks; i++) {
+            int pos = 0;
+            for (; pos<bucket_size; pos++)
+                if (table[hash*bucket_size+pos] == missing)
+                    break;
+            // Evict a different slot at every kick, so that moves do not cycle
+            // between the same few keys.
+            if (pos == bucket_size) pos = i % bucket_size;
+            std::swap(k, table[hash*bucket_size+pos]);
+            moved(hash*bucket_size+pos);
+            if (k == missing) return true;
+            size_t c1 = hash_1(k, mask);
+            hash = hash == c1 ? hash_2(k, mask) : c1;
+        }
+        return false;
+    }
+}
+
+template<typename T, T missing = (T)-1, int bucket_size = DISTSIM_CUCKOO_BUCKET_BYTES/sizeof(T)>
 class cuckoo_hash_set {
 public:
     typedef T value_type;
@@ -20,68 +218,91 @@ private:
     pointer ht;
     size_t mask;
     size_t sz;
+    uint32_t stash_size;
+    float max_load;
 
     size_t hash_1(const value_type& k) const {
-        return  k & mask;
+        return cuckoo_detail::hash_1(k, mask);
     }
 
     size_t hash_2(const value_type& k) const {
-        return ~k & mask;
+        return cuckoo_detail::hash_2(k, mask);
     }
 
-    void insert(value_type& k, value_type*& table) {
-        int h1 = hash_1(k);
-        for (int pos=0; pos<bucket_size; pos++)
-            if (table[h1*bucket_size+pos] == missing) {
-                table[h1*bucket_size+pos] = std::move(k);
-                return;
+    static size_t stash_capacity(size_t mask) {
+        return cuckoo_detail::stash_capacity<bucket_size>(mask);
+    }
+
+    static size_t slots(size_t mask) {
+        return cuckoo_detail::slots<bucket_size>(mask);
+    }
+
+    static pointer allocate(size_t mask) {
+        return cuckoo_detail::allocate<T, missing, bucket_size>(mask);
+    }
+
+    static bool place(value_type& k, pointer table, size_t mask) {
+        return cuckoo_detail::place<T, missing, bucket_size>(k, table, mask, [] (size_t) {});
+    }
+
+    /**
+     * Inserts a key that is not in the set, growing the table if needed.
+     */
+    void insert_new(value_type k) {
+        // A table with a single bucket can be filled completely.
+        if (mask != 0 && sz+1 > max_load*capacity()) rehash(2*mask+1);
+        while (!place(k, ht, mask)) {
+            if (stash_size < stash_capacity(mask)) {
+                ht[capacity()+stash_size++] = std::move(k);
+                break;
             }
-        int h2 = hash_2(k);
-        for (int pos=0; pos<bucket_size; pos++)
-            if (table[h2*bucket_size+pos] == missing) {
-                table[h2*bucket_size+pos] = std::move(k);
-                return;
+            rehash(2*mask+1);
+        }
+        sz++;
+    }
+
+    /**
+     * Moves all the keys to a table with the given mask, or a bigger one if
+     * they do not fit.
+     */
+    void rehash(size_t new_mask) {
+        while (true) {
+            pointer newt = allocate(new_mask);
+            uint32_t new_stash_size = 0;
+            bool ok = true;
+            for (size_t i=0; ok && i<slots(mask); i++) {
+                if (ht[i] == missing) continue;
+                value_type k = ht[i];
+                if (place(k, newt, new_mask)) continue;
+                if (new_stash_size < stash_capacity(new_mask))
+                    newt[(new_mask+1)*bucket_size+new_stash_size++] = std::move(k);
+                else ok = false;
             }
-        bool use_hash_1 = true;
-        for (unsigned i=0; i<mask; i++) {
-            value_type cuckooed;
-            size_t hash;
-            if (use_hash_1) hash = hash_1(k);
-            else hash = hash_2(k);
-            int pos = 0;
-            for (; pos<bucket_size; pos++)
-                if (table[hash*bucket_size+pos] == missing)
-                    break;
-            if (pos == bucket_size) {
-                cuckooed = std::move(table[hash*bucket_size]);
-                pos = 1;
-                for (; pos<bucket_size; pos++)
-                    table[hash*bucket_size+pos-1] = std::move(table[hash*bucket_size+pos]);
-                table[hash*bucket_size+pos-1] = std::move(k);
-            } else {
-                cuckooed = std::move(table[hash*bucket_size+pos]);
-                table[hash*bucket_size+pos] = std::move(k);
+            if (ok) {
+                free(ht);
+                ht = newt;
+                mask = new_mask;
+                stash_size = new_stash_size;
+                return;
             }
-            use_hash_1 = hash == hash_2(cuckooed);
-            k = std::move(cuckooed);
-            if (k == missing) return;
+            free(newt);
+            new_mask = 2*new_mask+1;
         }
-        rehash(table);
-        insert(k, table);
-    }
-
-    void rehash(value_type*& table) {
-        auto oldmask = mask;
-        if (mask == 0) mask = 1;
-        else mask = (mask<<1) | mask;
-        pointer newt = 0;
-        posix_memalign((void**)&newt, sizeof(T)*bucket_size, sizeof(T)*capacity());
-        std::fill(newt, newt+capacity(), missing);
-        for (size_t i=0; i<(oldmask+1)*bucket_size; i++)
-            if (table[i] != missing)
-                insert(table[i], newt);
-        std::swap(table, newt);
-        free(newt);
+    }
+
+    bool in_stash(const value_type& k) const {
+        return cuckoo_detail::find_in_stash<T, bucket_size>(ht, mask, stash_size, k) != (size_t)-1;
+    }
+
+    /**
+     * Looks for k in its two buckets, with SIMD instructions if possible.
+     */
+    bool probe(const value_type& k) const {
+        return cuckoo_detail::match<T, bucket_size>(ht, k, hash_1(k), hash_2(k)) != 0;
+    }
+
+    size_type end_offset() const {
+        return slots(mask);
     }
 public:
     class const_iterator {
@@ -96,7 +317,7 @@ public:
         typedef std::forward_iterator_tag iterator_category;
 
         const_iterator(const cuckoo_hash_set& container, size_type offset_): container(container), offset(offset_) {
-            while (offset != container.capacity() && container.ht[offset] == missing)
+            while (offset != container.end_offset() && container.ht[offset] == missing)
                 ++offset;
         }
         bool operator==(const const_iterator& other) const {
@@ -108,7 +329,7 @@ public:
 
         const_iterator& operator++() {
             ++offset;
-            while (offset != container.capacity() && container.ht[offset] == missing)
+            while (offset != container.end_offset() && container.ht[offset] == missing)
                 ++offset;
             return *this;
         }
@@ -128,28 +349,26 @@ public:
 
     cuckoo_hash_set& operator=(const cuckoo_hash_set& other) = delete;
 
-    cuckoo_hash_set(const cuckoo_hash_set& other): ht(nullptr) {
-        posix_memalign((void**)&ht, sizeof(T)*bucket_size, sizeof(T)*other.capacity());
-        for (uint64_t i=0; i<other.capacity(); i++)
+    cuckoo_hash_set(const cuckoo_hash_set& other): ht(allocate(other.mask)) {
+        for (uint64_t i=0; i<slots(other.mask); i++)
             ht[i] = other.ht[i];
         mask = other.mask;
         sz = other.sz;
+        stash_size = other.stash_size;
+        max_load = other.max_load;
     };
 
     ~cuckoo_hash_set() {
         free(ht);
     }
 
-    cuckoo_hash_set(): mask(0), sz(0) {
-        posix_memalign((void**)&ht, sizeof(T)*bucket_size, sizeof(T)*bucket_size);
-        std::fill(ht, ht+bucket_size, missing);
-    }
-    
+    cuckoo_hash_set(): ht(allocate(0)), mask(0), sz(0), stash_size(0), max_load(bucket_size >= 4 ? 0.93 : 0.85) {}
+
     const_iterator begin() const {
         return const_iterator(*this, 0);
     }
     const_iterator end() const {
-        return const_iterator(*this, capacity());
+        return const_iterator(*this, end_offset());
     }
 
     bool operator==(const cuckoo_hash_set<T>& oth) {
@@ -168,32 +387,121 @@ public:
         if (count(k)) {
             return;
         }
-        insert(k, ht);
-        sz++;
+        insert_new(k);
     }
     bool count(const value_type& k) const {
-            int h1 = hash_1(k);
-        int h2 = hash_2(k);
-        if (bucket_size == 4 && sizeof(T) == 4) {
-            __m128i cmp = _mm_set1_epi32(k);
-            __m128i b1 = _mm_load_si128((__m128i*)&ht[bucket_size*h1]);
-            __m128i b2 = _mm_load_si128((__m128i*)&ht[bucket_size*h2]);
-            __m128i flag = _mm_or_si128(_mm_cmpeq_epi32(cmp, b1), _mm_cmpeq_epi32(cmp, b2));
-            return _mm_movemask_epi8(flag);
+        // Not a short-circuit on the result of probe, which is unpredictable.
+        bool found = probe(k);
+        if (stash_size == 0) return found;
+        return found || in_stash(k);
+    }
+
+    /**
+     * Looks up n keys at once, setting bit i of out_bitmap if keys[i] is in
+     * the set and clearing it otherwise. Keys are handled in batches of 64,
+     * one word of the bitmap: the bucket addresses of the whole batch are
+     * computed and prefetched before any of them is compared, so that the
+     * cache misses of different keys overlap. Returns the number of keys
+     * that were found.
+     */
+    size_type count_many(const value_type* keys, size_type n, uint64_t* out_bitmap) const {
+        size_type found = 0;
+        size_t h1[64], h2[64];
+        for (size_type start=0; start<n; start+=64) {
+            size_type len = std::min<size_type>(64, n-start);
+            const value_type* batch = keys+start;
+            // Separate loops, so that the hashes can be computed with SIMD.
+            for (size_type i=0; i<len; i++) {
+                h1[i] = hash_1(batch[i]);
+                h2[i] = hash_2(batch[i]);
+            }
+            for (size_type i=0; i<len; i++) {
+                __builtin_prefetch(&ht[bucket_size*h1[i]]);
+                __builtin_prefetch(&ht[bucket_size*h2[i]]);
+            }
+            // Accumulated in a register, as stores to out_bitmap could alias the table.
+            uint64_t bits = 0;
+            for (size_type i=0; i<len; i++)
+                bits |= (uint64_t)(cuckoo_detail::match<T, bucket_size>(ht, batch[i], h1[i], h2[i]) != 0) << i;
+            if (stash_size != 0) {
+                for (size_type i=0; i<len; i++)
+                    if (!(bits >> i & 1) && in_stash(batch[i]))
+                        bits |= 1ULL << i;
+            }
+            out_bitmap[start/64] = bits;
+            found += __builtin_popcountll(bits);
         }
-        bool result = false;
-        for (unsigned i=0; i<bucket_size; i++)
-            result |= (ht[(bucket_size*h1)|i] == k || ht[(bucket_size*h2)|i] == k);
-        return result;
+        return found;
+    }
+
+    /**
+     * Same as above, resizing out_bitmap as needed.
+     */
+    size_type count_many(const std::vector<value_type>& keys, std::vector<uint64_t>& out_bitmap) const {
+        out_bitmap.resize((keys.size()+63)/64);
+        return count_many(keys.data(), keys.size(), out_bitmap.data());
     }
+
+    /**
+     * Inserts n keys at once. The keys that are already present are found
+     * first with count_many, and the table is grown once for the others
+     * (counting keys repeated in the batch once per occurrence), whose
+     * buckets are prefetched in batches of 64.
+     */
+    void insert_many(const value_type* keys, size_type n) {
+        std::vector<uint64_t> present((n+63)/64);
+        size_type found = count_many(keys, n, present.data());
+        if (found == n) return;
+        reserve(sz+n-found);
+        for (size_type start=0; start<n; start+=64) {
+            size_type len = std::min<size_type>(64, n-start);
+            uint64_t bits = present[start/64];
+            for (size_type i=0; i<len; i++) {
+                if (bits >> i & 1) continue;
+                __builtin_prefetch(&ht[bucket_size*hash_1(keys[start+i])]);
+                __builtin_prefetch(&ht[bucket_size*hash_2(keys[start+i])]);
+            }
+            // Keys repeated in the batch are only new the first time.
+            for (size_type i=0; i<len; i++)
+                if (!(bits >> i & 1)) insert(keys[start+i]);
+        }
+    }
+
+    void insert_many(const std::vector<value_type>& keys) {
+        insert_many(keys.data(), keys.size());
+    }
+    /**
+     * Same as count, but never uses SIMD instructions.
+     */
+    bool count_scalar(const value_type& k) const {
+        bool found = cuckoo_detail::match_scalar<T, bucket_size>(ht, k, hash_1(k), hash_2(k)) != 0;
+        if (stash_size == 0) return found;
+        return found || in_stash(k);
+    }
+
+    /**
+     * Grows the table so that it can hold sz keys without exceeding the
+     * maximum load factor.
+     */
     void reserve(size_type sz) {
-        if (sz <= capacity()) return;
-        mask++;
-        while (mask <= sz/bucket_size) mask <<= 1;
-        free(ht);
-        posix_memalign((void**)&ht, sizeof(T)*bucket_size, sizeof(T)*capacity());
-        std::fill(ht, ht+capacity(), missing);
-        mask--;
+        size_t new_mask = mask;
+        while (sz > max_load*(new_mask+1)*bucket_size) new_mask = 2*new_mask+1;
+        if (new_mask != mask) rehash(new_mask);
+    }
+
+    /**
+     * Sets the fraction of the slots that can be used before the table
+     * grows. Higher values save memory but make inserts slower.
+     */
+    void max_load_factor(float load) {
+        max_load = load;
+        reserve(sz);
+    }
+    float max_load_factor() const {
+        return max_load;
+    }
+    float load_factor() const {
+        return 1.0f * sz / capacity();
     }
     size_type size() const {
         return sz;
@@ -205,23 +513,32 @@ public:
         return sz == 0;
     }
     void erase(const value_type& k) {
-        int h1 = hash_1(k);
+        size_t h1 = hash_1(k);
         for (int pos=0; pos<bucket_size; pos++)
             if (ht[h1*bucket_size+pos] == k) {
                 ht[h1*bucket_size+pos] = missing;
                 sz--;
                 return;
             }
-        int h2 = hash_2(k);
+        size_t h2 = hash_2(k);
         for (int pos=0; pos<bucket_size; pos++)
             if (ht[h2*bucket_size+pos] == k) {
                 ht[h2*bucket_size+pos] = missing;
                 sz--;
                 return;
             }
+        for (size_t i=0; i<stash_size; i++)
+            if (ht[capacity()+i] == k) {
+                ht[capacity()+i] = std::move(ht[capacity()+stash_size-1]);
+                ht[capacity()+--stash_size] = missing;
+                sz--;
+                return;
+            }
     }
     void clear() {
-        std::fill(ht, ht+bucket_size*capacity(), missing);
+        std::fill(ht, ht+slots(mask), missing);
+        sz = 0;
+        stash_size = 0;
     }
 
     int front() const {
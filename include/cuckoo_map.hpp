@@ -0,0 +1,259 @@
+#ifndef DISTSIM_CUCKOO_MAP_HPP
+#define DISTSIM_CUCKOO_MAP_HPP
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "cuckoo.hpp"
+
+/**
+ * A map with the same layout and probing as cuckoo_hash_set: the keys are
+ * kept in a cuckoo table, and the values in a parallel array, so that
+ * lookups only touch the keys until they find a match. Meant for sparse
+ * indexes by id, whose size should follow the number of entries rather than
+ * the largest id.
+ */
+template<typename K, typename V, K missing = (K)-1, int bucket_size = DISTSIM_CUCKOO_BUCKET_BYTES/sizeof(K)>
+class cuckoo_hash_map {
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef size_t size_type;
+private:
+    K* keys;
+    V* values;
+    size_t mask;
+    size_t sz;
+    uint32_t stash_size;
+    float max_load;
+
+    size_t hash_1(const K& k) const {
+        return cuckoo_detail::hash_1(k, mask);
+    }
+
+    size_t hash_2(const K& k) const {
+        return cuckoo_detail::hash_2(k, mask);
+    }
+
+    static size_t stash_capacity(size_t mask) {
+        return cuckoo_detail::stash_capacity<bucket_size>(mask);
+    }
+
+    static size_t slots(size_t mask) {
+        return cuckoo_detail::slots<bucket_size>(mask);
+    }
+
+    /**
+     * Places k and v in the given tables. If no place is found, returns
+     * false, with k and v set to the entry that was left out.
+     */
+    static bool place(K& k, V& v, K* keys, V* values, size_t mask) {
+        return cuckoo_detail::place<K, missing, bucket_size>(k, keys, mask, [&] (size_t slot) {
+            std::swap(v, values[slot]);
+        });
+    }
+
+    /**
+     * Inserts an entry whose key is not in the map, growing the table if
+     * needed.
+     */
+    void insert_new(K k, V v) {
+        if (mask != 0 && sz+1 > max_load*capacity()) rehash(2*mask+1);
+        while (!place(k, v, keys, values, mask)) {
+            if (stash_size < stash_capacity(mask)) {
+                keys[capacity()+stash_size] = std::move(k);
+                values[capacity()+stash_size] = std::move(v);
+                stash_size++;
+                break;
+            }
+            rehash(2*mask+1);
+        }
+        sz++;
+    }
+
+    /**
+     * Moves all the entries to a table with the given mask. Values are moved
+     * rather than copied, so entries that do not fit are inserted again
+     * after growing the new table.
+     */
+    void rehash(size_t new_mask) {
+        K* new_keys = cuckoo_detail::allocate<K, missing, bucket_size>(new_mask);
+        V* new_values = new V[slots(new_mask)];
+        uint32_t new_stash_size = 0;
+        std::vector<std::pair<K, V>> left_out;
+        for (size_t i=0; i<slots(mask); i++) {
+            if (keys[i] == missing) continue;
+            K k = keys[i];
+            V v = std::move(values[i]);
+            if (place(k, v, new_keys, new_values, new_mask)) continue;
+            if (new_stash_size < stash_capacity(new_mask)) {
+                new_keys[(new_mask+1)*bucket_size+new_stash_size] = std::move(k);
+                new_values[(new_mask+1)*bucket_size+new_stash_size] = std::move(v);
+                new_stash_size++;
+            } else {
+                left_out.emplace_back(std::move(k), std::move(v));
+            }
+        }
+        free(keys);
+        delete[] values;
+        keys = new_keys;
+        values = new_values;
+        mask = new_mask;
+        stash_size = new_stash_size;
+        if (left_out.empty()) return;
+        sz -= left_out.size();
+        rehash(2*mask+1);
+        for (auto& [k, v]: left_out) insert_new(std::move(k), std::move(v));
+    }
+
+    /**
+     * Returns the slot that holds k, or -1.
+     */
+    size_t find_slot(const K& k) const {
+        size_t h1 = hash_1(k);
+        size_t h2 = hash_2(k);
+        unsigned bits = cuckoo_detail::match<K, bucket_size>(keys, k, h1, h2);
+        if (bits) return cuckoo_detail::matched_slot<bucket_size>(bits, h1, h2);
+        if (stash_size == 0) return -1;
+        return cuckoo_detail::find_in_stash<K, bucket_size>(keys, mask, stash_size, k);
+    }
+public:
+    cuckoo_hash_map& operator=(const cuckoo_hash_map& other) = delete;
+
+    cuckoo_hash_map(const cuckoo_hash_map& other):
+        keys(cuckoo_detail::allocate<K, missing, bucket_size>(other.mask)), values(new V[slots(other.mask)]),
+        mask(other.mask), sz(other.sz), stash_size(other.stash_size), max_load(other.max_load) {
+        for (size_t i=0; i<slots(mask); i++) {
+            keys[i] = other.keys[i];
+            if (keys[i] != missing) values[i] = other.values[i];
+        }
+    }
+
+    cuckoo_hash_map():
+        keys(cuckoo_detail::allocate<K, missing, bucket_size>(0)), values(new V[slots(0)]),
+        mask(0), sz(0), stash_size(0), max_load(bucket_size >= 4 ? 0.93 : 0.85) {}
+
+    ~cuckoo_hash_map() {
+        free(keys);
+        delete[] values;
+    }
+
+    /**
+     * Returns a pointer to the value of k, or nullptr if k is not in the map.
+     */
+    V* find(const K& k) {
+        size_t slot = find_slot(k);
+        return slot == (size_t)-1 ? nullptr : &values[slot];
+    }
+    const V* find(const K& k) const {
+        size_t slot = find_slot(k);
+        return slot == (size_t)-1 ? nullptr : &values[slot];
+    }
+
+    bool count(const K& k) const {
+        return find_slot(k) != (size_t)-1;
+    }
+
+    /**
+     * Returns the value of k, throwing if k is not in the map.
+     */
+    V& at(const K& k) {
+        V* v = find(k);
+        if (v == nullptr) throw std::out_of_range("Key not in map");
+        return *v;
+    }
+    const V& at(const K& k) const {
+        const V* v = find(k);
+        if (v == nullptr) throw std::out_of_range("Key not in map");
+        return *v;
+    }
+
+    /**
+     * Returns the value of k, inserting a default constructed one if k is
+     * not in the map.
+     */
+    V& operator[](const K& k) {
+        V* v = find(k);
+        if (v != nullptr) return *v;
+        insert_new(k, V());
+        return *find(k);
+    }
+
+    /**
+     * Inserts k with value v. Returns false, leaving the map unchanged, if k
+     * was already in it.
+     */
+    bool insert(const K& k, V v) {
+        if (count(k)) return false;
+        insert_new(k, std::move(v));
+        return true;
+    }
+
+    /**
+     * Removes k from the map. Returns false if k was not in it.
+     */
+    bool erase(const K& k) {
+        size_t slot = find_slot(k);
+        if (slot == (size_t)-1) return false;
+        if (slot >= capacity()) {
+            size_t last = capacity()+--stash_size;
+            keys[slot] = std::move(keys[last]);
+            values[slot] = std::move(values[last]);
+            slot = last;
+        }
+        keys[slot] = missing;
+        values[slot] = V();
+        sz--;
+        return true;
+    }
+
+    /**
+     * Calls f(key, value) for every entry, in no particular order.
+     */
+    template<typename F>
+    void for_each(F&& f) {
+        for (size_t i=0; i<slots(mask); i++)
+            if (keys[i] != missing) f(keys[i], values[i]);
+    }
+    template<typename F>
+    void for_each(F&& f) const {
+        for (size_t i=0; i<slots(mask); i++)
+            if (keys[i] != missing) f(keys[i], (const V&)values[i]);
+    }
+
+    /**
+     * Grows the table so that it can hold sz entries without exceeding the
+     * maximum load factor.
+     */
+    void reserve(size_type sz) {
+        size_t new_mask = mask;
+        while (sz > max_load*(new_mask+1)*bucket_size) new_mask = 2*new_mask+1;
+        if (new_mask != mask) rehash(new_mask);
+    }
+
+    void max_load_factor(float load) {
+        max_load = load;
+        reserve(sz);
+    }
+    float max_load_factor() const {
+        return max_load;
+    }
+    float load_factor() const {
+        return 1.0f * sz / capacity();
+    }
+    size_type size() const {
+        return sz;
+    }
+    size_type capacity() const {
+        return (mask+1)*bucket_size;
+    }
+    bool empty() const {
+        return sz == 0;
+    }
+    void clear() {
+        std::fill(keys, keys+slots(mask), missing);
+        for (size_t i=0; i<slots(mask); i++) values[i] = V();
+        sz = 0;
+        stash_size = 0;
+    }
+};
+#endif
@@ -0,0 +1,154 @@
+#ifndef DISTSIM_EDGE_LIST_FILE_HPP
+#define DISTSIM_EDGE_LIST_FILE_HPP
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "csr.hpp"
+#include "graph_file.hpp"
+#include "parallel.hpp"
+
+/**
+ * A graph read from a text edge list, with its nodes numbered from 0.
+ * ids[n] is the id that node n had in the file.
+ */
+struct imported_graph {
+    csr_graph<std::uint32_t> graph;
+    std::vector<std::uint64_t> ids;
+};
+
+namespace edge_list_detail {
+    typedef std::vector<std::pair<std::uint64_t, std::uint64_t>> raw_edges_t;
+
+    inline bool is_digit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    inline bool is_separator(char c) {
+        return c == ' ' || c == '\t' || c == ',' || c == ';';
+    }
+
+    /**
+     * Parses the lines from p to end (exclusive), which must start at the
+     * beginning of a line, and appends the pairs of ids found to edges.
+     */
+    inline void parse(const char* p, const char* end, raw_edges_t& edges) {
+        while (p < end) {
+            while (p < end && is_separator(*p)) p++;
+            std::uint64_t a = 0, b = 0;
+            bool ok = p < end && is_digit(*p);
+            for (; p < end && is_digit(*p); p++) a = a*10 + (*p - '0');
+            while (p < end && is_separator(*p)) p++;
+            ok &= p < end && is_digit(*p);
+            for (; p < end && is_digit(*p); p++) b = b*10 + (*p - '0');
+            if (ok) edges.emplace_back(a, b);
+            p = std::find(p, end, '\n');
+            if (p < end) p++;
+        }
+    }
+
+    /**
+     * The parsed chunks of a file, as a source for build_csr. Self loops are
+     * skipped.
+     */
+    class chunks_source {
+        const std::vector<raw_edges_t>& edges;
+    public:
+        chunks_source(const std::vector<raw_edges_t>& edges): edges(edges) {}
+        std::size_t chunks() const {
+            return edges.size();
+        }
+        template<typename F>
+        void chunk(std::size_t c, F&& emit) const {
+            for (auto [a, b]: edges[c])
+                if (a != b) emit(a, b);
+        }
+    };
+}
+
+/**
+ * Reads a graph from a text file with an edge per line, given by two
+ * non-negative integer ids separated by spaces, tabs, commas or semicolons,
+ * as written by graph_gen. Anything after the two ids is ignored, as well as
+ * lines that do not start with two ids (such as headers or comments).
+ *
+ * The file is mapped in memory and split in chunks that are parsed on
+ * nthreads threads (-1 means one per core). Nodes are renumbered from 0 in
+ * the order of their ids, so a file whose ids are already dense keeps them;
+ * self loops and repeated edges are dropped. Each edge is added in both
+ * directions unless directed is true.
+ */
+inline imported_graph import_edge_list(const std::string& path, bool directed=false, int nthreads=-1) {
+    using namespace edge_list_detail;
+    static constexpr std::size_t chunk_bytes = 1<<22;
+    mapped_file file(path);
+    const char* data = file.data();
+    std::size_t size = file.size();
+
+    // Every chunk starts after the first newline past its nominal start,
+    // and ends where the next one starts.
+    std::size_t num_chunks = (size + chunk_bytes - 1) / chunk_bytes;
+    std::vector<std::size_t> starts(num_chunks+1, size);
+    for (std::size_t c=1; c<num_chunks; c++) {
+        const char* nl = (const char*)memchr(data + c*chunk_bytes, '\n', size - c*chunk_bytes);
+        starts[c] = nl ? nl + 1 - data : size;
+    }
+    if (num_chunks) starts[0] = 0;
+    std::vector<raw_edges_t> edges(num_chunks);
+    std::vector<std::uint64_t> max_id(num_chunks);
+    parallel_for(num_chunks, nthreads, [&] (std::uint64_t c) {
+        parse(data + starts[c], data + starts[c+1], edges[c]);
+        for (auto [a, b]: edges[c]) max_id[c] = std::max(max_id[c], std::max(a, b));
+    });
+
+    imported_graph ans;
+    std::uint64_t max = num_chunks ? *std::max_element(max_id.begin(), max_id.end()) : 0;
+    std::uint64_t total = 0;
+    for (const auto& e: edges) total += e.size();
+    if (max < 2*total + 1024) {
+        // Dense enough ids: mark the ones that are used in a table.
+        std::unique_ptr<std::atomic<std::uint32_t>[]> dense(new std::atomic<std::uint32_t>[max+1]());
+        parallel_for(num_chunks, nthreads, [&] (std::uint64_t c) {
+            for (auto [a, b]: edges[c]) {
+                dense[a].store(1, std::memory_order_relaxed);
+                dense[b].store(1, std::memory_order_relaxed);
+            }
+        });
+        for (std::uint64_t id=0; id<=max && total; id++) {
+            if (!dense[id].load(std::memory_order_relaxed)) continue;
+            dense[id].store(ans.ids.size(), std::memory_order_relaxed);
+            ans.ids.push_back(id);
+        }
+        if (ans.ids.size() > (std::uint64_t)UINT32_MAX) throw std::runtime_error("Too many nodes in " + path);
+        parallel_for(num_chunks, nthreads, [&] (std::uint64_t c) {
+            for (auto& [a, b]: edges[c]) {
+                a = dense[a].load(std::memory_order_relaxed);
+                b = dense[b].load(std::memory_order_relaxed);
+            }
+        });
+    } else {
+        for (const auto& e: edges) {
+            for (auto [a, b]: e) {
+                ans.ids.push_back(a);
+                ans.ids.push_back(b);
+            }
+        }
+        std::sort(ans.ids.begin(), ans.ids.end());
+        ans.ids.erase(std::unique(ans.ids.begin(), ans.ids.end()), ans.ids.end());
+        ans.ids.shrink_to_fit();
+        if (ans.ids.size() > (std::uint64_t)UINT32_MAX) throw std::runtime_error("Too many nodes in " + path);
+        parallel_for(num_chunks, nthreads, [&] (std::uint64_t c) {
+            for (auto& [a, b]: edges[c]) {
+                a = std::lower_bound(ans.ids.begin(), ans.ids.end(), a) - ans.ids.begin();
+                b = std::lower_bound(ans.ids.begin(), ans.ids.end(), b) - ans.ids.begin();
+            }
+        });
+    }
+    ans.graph = build_csr(ans.ids.size(), chunks_source(edges), directed, nthreads, true);
+    return ans;
+}
+#endif
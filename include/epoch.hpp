@@ -0,0 +1,185 @@
+#ifndef DISTSIM_EPOCH_HPP
+#define DISTSIM_EPOCH_HPP
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/**
+ * Epoch-based memory reclamation.
+ *
+ * Readers access shared objects inside a critical section, delimited by a
+ * guard. Writers unpublish an object and then retire it: its deleter only
+ * runs once every thread that might still see it has left its critical
+ * section. Critical sections are reentrant and cost two stores and a fence
+ * when the thread already owns a slot, which is the case for the threads
+ * that called register_thread.
+ */
+class EpochManager {
+    static const int max_threads = 256;
+    static const std::uint64_t quiescent = ~0ULL;
+    struct alignas(64) slot_t {
+        std::atomic<std::uint64_t> epoch{quiescent};
+        std::atomic<bool> taken{false};
+    };
+    struct thread_state {
+        EpochManager* owner = nullptr;
+        int slot = -1;
+        int depth = 0;
+        bool registered = false;
+    };
+    static thread_state& tls() {
+        static thread_local thread_state state;
+        return state;
+    }
+
+    std::atomic<std::uint64_t> global_epoch{1};
+    slot_t slots[max_threads];
+    std::mutex retired_mutex;
+    std::vector<std::pair<std::uint64_t, std::function<void()>>> retired;
+    std::atomic<std::size_t> retired_count{0};
+
+    int acquire_slot() {
+        while (true) {
+            for (int i=0; i<max_threads; i++) {
+                if (slots[i].taken) continue;
+                bool expected = false;
+                if (slots[i].taken.compare_exchange_strong(expected, true)) return i;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    void release_slot(int slot) {
+        slots[slot].epoch.store(quiescent, std::memory_order_release);
+        slots[slot].taken.store(false, std::memory_order_release);
+    }
+
+    void enter(int slot) {
+        slots[slot].epoch.store(global_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    void exit(int slot) {
+        slots[slot].epoch.store(quiescent, std::memory_order_release);
+    }
+public:
+    EpochManager() = default;
+    EpochManager(const EpochManager&) = delete;
+    EpochManager& operator=(const EpochManager&) = delete;
+
+    /**
+     * A critical section: while it exists, nothing retired after its
+     * creation gets reclaimed.
+     */
+    class guard {
+        EpochManager* manager;
+        int slot;
+        bool own_slot;
+    public:
+        guard(EpochManager& m): manager(&m), slot(-1), own_slot(false) {
+            auto& state = tls();
+            if (state.owner == manager) {
+                if (state.depth++ == 0) manager->enter(state.slot);
+                return;
+            }
+            slot = manager->acquire_slot();
+            if (state.owner == nullptr) {
+                state = thread_state{manager, slot, 1, false};
+            } else {
+                own_slot = true;
+            }
+            manager->enter(slot);
+        }
+        ~guard() {
+            auto& state = tls();
+            if (own_slot) {
+                manager->release_slot(slot);
+                return;
+            }
+            if (--state.depth != 0) return;
+            manager->exit(state.slot);
+            if (!state.registered) {
+                manager->release_slot(state.slot);
+                state = thread_state{};
+            }
+        }
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+    };
+
+    /**
+     * Gives the calling thread a slot of its own until unregister_thread
+     * is called, making its critical sections cheaper.
+     */
+    void register_thread() {
+        auto& state = tls();
+        if (state.owner != nullptr) throw std::runtime_error("Thread already registered");
+        state = thread_state{this, acquire_slot(), 0, true};
+    }
+
+    /**
+     * Releases the slot of the calling thread.
+     */
+    void unregister_thread() {
+        auto& state = tls();
+        if (state.owner != this || !state.registered) return;
+        release_slot(state.slot);
+        state = thread_state{};
+    }
+
+    /**
+     * Schedules deleter to be called once no critical section can still
+     * see the object it deletes, which must already be unreachable for
+     * new readers.
+     */
+    void retire(std::function<void()> deleter) {
+        std::uint64_t epoch = global_epoch.fetch_add(1) + 1;
+        std::lock_guard<std::mutex> lck(retired_mutex);
+        retired.emplace_back(epoch, std::move(deleter));
+        retired_count++;
+    }
+
+    /**
+     * Runs the deleters of the objects that are no longer reachable. If
+     * another thread is already doing it, returns immediately.
+     */
+    void reclaim() {
+        if (retired_count == 0) return;
+        std::unique_lock<std::mutex> lck(retired_mutex, std::try_to_lock);
+        if (!lck.owns_lock()) return;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::uint64_t min_epoch = quiescent;
+        for (int i=0; i<max_threads; i++)
+            min_epoch = std::min(min_epoch, slots[i].epoch.load(std::memory_order_acquire));
+        std::vector<std::function<void()>> to_delete;
+        std::size_t kept = 0;
+        for (auto& r: retired) {
+            if (r.first <= min_epoch) to_delete.push_back(std::move(r.second));
+            else retired[kept++] = std::move(r);
+        }
+        retired.resize(kept);
+        retired_count = kept;
+        lck.unlock();
+        for (auto& del: to_delete) del();
+    }
+
+    /**
+     * Runs all the pending deleters. No critical section may be active.
+     */
+    void reclaim_all() {
+        std::lock_guard<std::mutex> lck(retired_mutex);
+        for (auto& r: retired) r.second();
+        retired.clear();
+        retired_count = 0;
+    }
+
+    ~EpochManager() {
+        reclaim_all();
+    }
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef DISTSIM_FUTEX_HPP
+#define DISTSIM_FUTEX_HPP
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "futex words must be plain 32-bit integers");
+
+/**
+ * Blocks while word still contains expected, or until timeout expires.
+ * A negative timeout means waiting forever. Spurious wakeups are possible.
+ */
+inline void futex_wait(
+    std::atomic<std::uint32_t>* word,
+    std::uint32_t expected,
+    std::chrono::nanoseconds timeout = std::chrono::nanoseconds(-1)
+) {
+    timespec ts;
+    timespec* tsp = nullptr;
+    if (timeout.count() >= 0) {
+        ts.tv_sec = timeout.count() / 1000000000;
+        ts.tv_nsec = timeout.count() % 1000000000;
+        tsp = &ts;
+    }
+    syscall(SYS_futex, (std::uint32_t*)word, FUTEX_WAIT_PRIVATE, expected, tsp, nullptr, 0);
+}
+
+/**
+ * Wakes all the threads blocked on word.
+ */
+inline void futex_wake_all(std::atomic<std::uint32_t>* word) {
+    syscall(SYS_futex, (std::uint32_t*)word, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+#endif
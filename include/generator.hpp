@@ -0,0 +1,167 @@
+#ifndef DISTSIM_GENERATOR_HPP
+#define DISTSIM_GENERATOR_HPP
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include "common.hpp"
+#include "hardware_manager.hpp"
+#include "rng.hpp"
+
+/**
+ * A source of events that is fired by the workers of a HardwareManager,
+ * following the manager's own clock. Different firings of the same
+ * generator may run concurrently on different workers, so next_interval
+ * and fire must be thread safe.
+ *
+ * While a generator is active it counts as pending work, so the manager
+ * does not become idle until it is done.
+ */
+template <typename T>
+class EventGenerator {
+    friend class HardwareManager<T>;
+    HardwareManager<T>* manager_ = nullptr;
+    // Time of the next firing, in nanoseconds since the start of the manager's clock.
+    std::atomic<long long> next_fire{0};
+    std::atomic<std::uint64_t> fired_{0};
+    std::atomic<bool> done_{false};
+    const std::uint64_t limit;
+
+    /**
+     * Marks the generator as done. Returns false if it already was.
+     */
+    bool finish() {
+        if (done_.exchange(true)) return false;
+        if (manager_) {
+            manager_->work_done();
+            manager_->notify();
+        }
+        return true;
+    }
+protected:
+    /**
+     * Returns the time between two consecutive firings.
+     */
+    virtual std::chrono::nanoseconds next_interval() = 0;
+
+    /**
+     * Generates the event.
+     */
+    virtual void fire(HardwareManager<T>& manager) = 0;
+public:
+    /**
+     * Creates a generator that fires at most limit times.
+     */
+    EventGenerator(std::uint64_t limit = std::numeric_limits<std::uint64_t>::max()): limit(limit) {}
+
+    /**
+     * Returns the number of events generated so far.
+     */
+    std::uint64_t fired() const {
+        return std::min<std::uint64_t>(fired_, limit);
+    }
+
+    /**
+     * Returns true if the generator will not fire anymore.
+     */
+    bool done() const {
+        return done_;
+    }
+
+    /**
+     * Stops the generator.
+     */
+    void stop() {
+        finish();
+    }
+    virtual ~EventGenerator() = default;
+};
+
+/**
+ * Chooses the node on which an event is generated.
+ */
+template <typename T>
+using node_chooser_t = std::function<node_id_t(HardwareManager<T>&)>;
+
+/**
+ * Chooses any node of the manager, uniformly at random.
+ */
+template <typename T>
+node_chooser_t<T> uniform_nodes() {
+    return [] (HardwareManager<T>& manager) {
+        return manager.get_random_node();
+    };
+}
+
+/**
+ * Chooses a node with probability proportional to its weight.
+ *
+ * Takes as an argument the vector of the prefix sums of the weights,
+ * indexed by node id.
+ */
+template <typename T>
+node_chooser_t<T> weighted_nodes(std::vector<std::uint64_t> weight_ps) {
+    return [weight_ps{std::move(weight_ps)}] (HardwareManager<T>&) {
+        return (node_id_t) rng.choose_weighted(weight_ps);
+    };
+}
+
+/**
+ * Generates a message with the given data on a chosen node, at a
+ * fixed rate.
+ */
+template <typename T>
+class PeriodicGenerator: public EventGenerator<T> {
+    const std::chrono::nanoseconds interval;
+    const node_chooser_t<T> choose;
+    const T data;
+protected:
+    std::chrono::nanoseconds next_interval() override {
+        return interval;
+    }
+    void fire(HardwareManager<T>& manager) override {
+        manager.gen_message(choose(manager), data);
+    }
+public:
+    template<typename D>
+    PeriodicGenerator(
+        const D& interval,
+        node_chooser_t<T> choose,
+        const T& data = T{},
+        std::uint64_t limit = std::numeric_limits<std::uint64_t>::max()
+    ): EventGenerator<T>(limit), interval(std::chrono::duration_cast<std::chrono::nanoseconds>(interval)),
+       choose(std::move(choose)), data(data) {}
+};
+
+/**
+ * Generates a message with the given data on a chosen node, following
+ * a Poisson arrival process with the given mean interval.
+ */
+template <typename T>
+class PoissonGenerator: public EventGenerator<T> {
+    const double mean_interval;
+    const node_chooser_t<T> choose;
+    const T data;
+protected:
+    std::chrono::nanoseconds next_interval() override {
+        // Uniform in (0, 1], so that the logarithm is finite.
+        double u = ((rng() >> 11) + 1) * 0x1.0p-53;
+        return std::chrono::nanoseconds((long long)(-std::log(u) * mean_interval));
+    }
+    void fire(HardwareManager<T>& manager) override {
+        manager.gen_message(choose(manager), data);
+    }
+public:
+    template<typename D>
+    PoissonGenerator(
+        const D& mean_interval,
+        node_chooser_t<T> choose,
+        const T& data = T{},
+        std::uint64_t limit = std::numeric_limits<std::uint64_t>::max()
+    ): EventGenerator<T>(limit),
+       mean_interval(std::chrono::duration_cast<std::chrono::nanoseconds>(mean_interval).count()),
+       choose(std::move(choose)), data(data) {}
+};
+
+#endif
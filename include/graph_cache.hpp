@@ -0,0 +1,90 @@
+#ifndef DISTSIM_GRAPH_CACHE_HPP
+#define DISTSIM_GRAPH_CACHE_HPP
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "csr.hpp"
+#include "graph_file.hpp"
+#include "graph_gen.hpp"
+
+/**
+ * Part of every cache key, to be increased whenever a generator changes the
+ * graphs it produces, so that stale files are not used.
+ */
+static constexpr int graph_cache_version = 1;
+
+/**
+ * Returns the name of the cache file of the graph generated by the given
+ * generator (barabasi or one of generator_names) with the given parameters,
+ * as for with_generator. Options are only part of the name for the
+ * generators that use them, written exactly.
+ */
+inline std::string graph_cache_key(const std::string& name, std::uint64_t N, std::uint64_t par, std::uint64_t S,
+                                   const generator_options& options) {
+    std::ostringstream key;
+    key << name << "-" << N << "-" << par << "-" << S << std::hexfloat;
+    if (name == "watts_strogatz") key << "-" << options.rewiring;
+    if (name == "rmat") key << "-" << options.rmat_a << "-" << options.rmat_b << "-" << options.rmat_c;
+    key << "-v" << graph_cache_version << ".graph";
+    return key.str();
+}
+
+/**
+ * Generates the graph of the given generator (barabasi or one of
+ * generator_names) in CSR form on nthreads threads, as it is stored in the
+ * cache. Edges listed from it with csr_edge_list come in the same order
+ * whether the graph was cached or not. Returns false if there is no
+ * generator with that name.
+ */
+inline bool generate_csr(const std::string& name, std::uint64_t N, std::uint64_t par, std::uint64_t S,
+                         const generator_options& options, csr_graph<>& graph, int nthreads=-1) {
+    if (name == "barabasi") {
+        graph = build_csr(N, gen_barabasi_albert(N, par, S), false, nthreads);
+        return true;
+    }
+    return with_generator(name, N, par, S, options, [&] (const auto& source) {
+        graph = build_csr(N, source, false, nthreads);
+    });
+}
+
+/**
+ * Returns the graph generated by the given generator, mapped from a binary
+ * graph file in the directory dir. If the file does not exist or is not
+ * valid, the graph is generated on nthreads threads and written there first;
+ * the directory is created if needed. Returns nullptr if there is no
+ * generator with that name.
+ *
+ * Files are written under a temporary name and then renamed, so processes
+ * that share the cache never see a partial file: if they generate the same
+ * graph at the same time, one of the copies wins.
+ */
+inline std::unique_ptr<mapped_graph> cached_graph(const std::string& dir, const std::string& name,
+                                                  std::uint64_t N, std::uint64_t par, std::uint64_t S,
+                                                  const generator_options& options, int nthreads=-1) {
+    std::string path = dir + "/" + graph_cache_key(name, N, par, S, options);
+    if (is_graph_file(path)) {
+        try {
+            return std::make_unique<mapped_graph>(path);
+        } catch (std::runtime_error&) {
+            // Generated again below.
+        }
+    }
+    csr_graph<> graph;
+    if (!generate_csr(name, N, par, S, options, graph, nthreads)) return nullptr;
+    if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+        throw std::runtime_error("Could not create cache directory " + dir);
+    std::string temp = path + ".tmp" + std::to_string(getpid());
+    write_graph_file(temp, graph);
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        throw std::runtime_error("Could not write " + path);
+    }
+    return std::make_unique<mapped_graph>(path);
+}
+#endif
@@ -0,0 +1,188 @@
+#ifndef DISTSIM_GRAPH_FILE_HPP
+#define DISTSIM_GRAPH_FILE_HPP
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "csr.hpp"
+#include "rng.hpp"
+
+/**
+ * Header of a binary graph file. It is followed by the offsets (nodes+1
+ * 64-bit integers) and the targets (arcs 32-bit integers) of the graph in
+ * CSR form, as in csr_graph, all in the byte order of the machine that wrote
+ * the file. The checksum covers the offsets and the targets.
+ */
+struct graph_file_header {
+    static constexpr char file_magic[8] = {'D', 'S', 'I', 'M', 'G', 'R', 'P', 'H'};
+    static constexpr std::uint32_t file_version = 1;
+    static constexpr std::uint32_t directed_flag = 1;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t flags;
+    std::uint64_t nodes;
+    std::uint64_t arcs;
+    std::uint64_t checksum;
+};
+
+/**
+ * Returns true if the file starts like a binary graph file.
+ */
+inline bool is_graph_file(const std::string& path) {
+    char magic[sizeof(graph_file_header::file_magic)] = {};
+    std::ifstream f(path, std::ios::binary);
+    f.read(magic, sizeof(magic));
+    return f && std::memcmp(magic, graph_file_header::file_magic, sizeof(magic)) == 0;
+}
+
+/**
+ * Checksum of the sections of a graph file: each 64-bit word is mixed with
+ * its position, so that swapped or shifted words are detected too, and the
+ * results are summed. The checksum of several sections is the sum of their
+ * checksums, with first_word the position of the section in the file.
+ */
+inline std::uint64_t graph_checksum(const void* data, std::size_t bytes, std::uint64_t first_word = 0) {
+    const char* p = (const char*)data;
+    std::uint64_t sum = 0;
+    std::size_t words = bytes / 8;
+    for (std::size_t i=0; i<words; i++) {
+        std::uint64_t w;
+        std::memcpy(&w, p + 8*i, 8);
+        sum += mix64(w ^ ((first_word + i) * 0x9E3779B97F4A7C15ULL));
+    }
+    if (bytes % 8) {
+        std::uint64_t w = 0;
+        std::memcpy(&w, p + 8*words, bytes % 8);
+        sum += mix64(w ^ ((first_word + words) * 0x9E3779B97F4A7C15ULL));
+    }
+    return sum;
+}
+
+/**
+ * Writes graph to a binary graph file.
+ */
+inline void write_graph_file(const std::string& path, const csr_graph<std::uint32_t>& graph, bool directed=false) {
+    graph_file_header header;
+    std::memcpy(header.magic, graph_file_header::file_magic, sizeof(header.magic));
+    header.version = graph_file_header::file_version;
+    header.flags = directed ? graph_file_header::directed_flag : 0;
+    header.nodes = graph.nodes();
+    header.arcs = graph.arcs();
+    std::size_t offsets_bytes = graph.offsets.size() * sizeof(std::uint64_t);
+    header.checksum = graph_checksum(graph.offsets.data(), offsets_bytes) +
+        graph_checksum(graph.targets.data(), graph.targets.size() * sizeof(std::uint32_t), offsets_bytes / 8);
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f.write((const char*)&header, sizeof(header));
+    f.write((const char*)graph.offsets.data(), offsets_bytes);
+    f.write((const char*)graph.targets.data(), graph.targets.size() * sizeof(std::uint32_t));
+    f.close();
+    if (!f) throw std::runtime_error("Could not write graph file " + path);
+}
+
+/**
+ * A whole file mapped read-only in memory.
+ */
+class mapped_file {
+    void* map;
+    std::size_t length;
+public:
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    explicit mapped_file(const std::string& path): map(MAP_FAILED), length(0) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) throw std::runtime_error("Could not open " + path);
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            length = st.st_size;
+            map = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+            if (map == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Could not map " + path);
+            }
+        }
+        close(fd);
+    }
+
+    ~mapped_file() {
+        if (map != MAP_FAILED) munmap(map, length);
+    }
+
+    const char* data() const {
+        return map == MAP_FAILED ? nullptr : (const char*)map;
+    }
+    std::size_t size() const {
+        return length;
+    }
+};
+
+/**
+ * A binary graph file mapped in memory, with the same interface as
+ * csr_graph: neighbours are read straight from the file, and pages are only
+ * loaded when touched and shared between processes that map the same file.
+ */
+class mapped_graph {
+    mapped_file file;
+    const graph_file_header* header;
+    const std::uint64_t* offsets;
+    const std::uint32_t* targets;
+
+    [[noreturn]] static void fail(const std::string& path, const char* why) {
+        throw std::runtime_error("Invalid graph file " + path + ": " + why);
+    }
+public:
+    typedef std::uint32_t id_type;
+
+    /**
+     * Maps the given file. If verify is true, the checksum and the offsets
+     * and targets are checked, which reads the whole file.
+     */
+    explicit mapped_graph(const std::string& path, bool verify = true): file(path) {
+        std::size_t length = file.size();
+        if (length < sizeof(graph_file_header)) fail(path, "too short");
+        header = (const graph_file_header*)file.data();
+        if (std::memcmp(header->magic, graph_file_header::file_magic, sizeof(header->magic)) != 0)
+            fail(path, "not a graph file");
+        if (header->version != graph_file_header::file_version) fail(path, "unknown version");
+        if (header->nodes >= length / 8 || header->arcs >= length / 4 ||
+            length != sizeof(graph_file_header) + (header->nodes+1) * 8 + header->arcs * 4)
+            fail(path, "wrong size");
+        offsets = (const std::uint64_t*)(header+1);
+        targets = (const std::uint32_t*)(offsets + header->nodes + 1);
+        if (!verify) return;
+        std::size_t offsets_bytes = (header->nodes+1) * 8;
+        if (graph_checksum(offsets, offsets_bytes) + graph_checksum(targets, header->arcs * 4, offsets_bytes / 8) != header->checksum)
+            fail(path, "wrong checksum");
+        if (offsets[0] != 0 || offsets[header->nodes] != header->arcs) fail(path, "bad offsets");
+        for (std::uint64_t n=0; n<header->nodes; n++)
+            if (offsets[n] > offsets[n+1]) fail(path, "bad offsets");
+        for (std::uint64_t a=0; a<header->arcs; a++)
+            if (targets[a] >= header->nodes) fail(path, "bad targets");
+    }
+
+    bool directed() const {
+        return header->flags & graph_file_header::directed_flag;
+    }
+    std::uint64_t nodes() const {
+        return header->nodes;
+    }
+    std::uint64_t arcs() const {
+        return header->arcs;
+    }
+    std::uint64_t degree(std::uint64_t n) const {
+        return offsets[n+1] - offsets[n];
+    }
+    const std::uint32_t* neighbours_begin(std::uint64_t n) const {
+        return targets + offsets[n];
+    }
+    const std::uint32_t* neighbours_end(std::uint64_t n) const {
+        return targets + offsets[n+1];
+    }
+};
+#endif
@@ -1,57 +1,761 @@
 #ifndef DISTSIM_GRAPH_GEN_HPP
 #define DISTSIM_GRAPH_GEN_HPP
-#include <vector>
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "parallel.hpp"
 #include "rng.hpp"
 
 typedef std::vector<std::pair<std::size_t, std::size_t>> edge_list_t;
 
 /**
- * Generates a new random connected graph according to the Erdos-Renyi model (more or less).
+ * Edges of a random connected graph according to the Erdos-Renyi model,
+ * split in chunks that can be generated independently and in any order.
  *
- * N, M and S are, respectively, the number of nodes, the number of edges and the seed to use.
- * If M is not at least N-1, it is increased accordingly.
+ * Node i > 0 is connected to a random node before it, which makes the graph
+ * connected, and every other pair of nodes is connected independently with
+ * the probability that makes M the expected number of edges. Each chunk
+ * covers a range of nodes and walks the pairs (i, j), j < i, of those nodes
+ * jumping directly from one edge to the next with geometrically distributed
+ * skips, so the time is proportional to the number of nodes and edges rather
+ * than of pairs. Chunks are seeded from S and their index, so the edges do
+ * not depend on how many threads generate them.
  */
-inline edge_list_t gen_conn_erdos(int N, int M, int S=0) {
-    if (M < N-1) M = N-1;
-    edge_list_t ans;
-    for (int i=1; i<N; i++)
-        ans.emplace_back(i, rng(i));
-    std::vector<uint64_t> excluded;
-    for (auto x: ans) excluded.push_back((uint64_t)x.first*(x.first-1)/2+x.second);
-    std::sort(excluded.begin(), excluded.end());
-    auto to_add = rng.get_distinct(M-N+1, (uint64_t)N*(N-1)/2, excluded);
-    for (auto edg: to_add) {
-        std::size_t first = round(sqrt(2*(edg+1)));
-        std::size_t second = edg-first*(first-1)/2;
-        ans.emplace_back(first, second);
+class erdos_source {
+    std::uint64_t N;
+    double p;
+    double log_q;
+    std::uint64_t seed;
+    // Chunk c covers nodes from first_node[c] to first_node[c+1] (exclusive).
+    std::vector<std::uint64_t> first_node;
+
+    /**
+     * Returns the number of pairs to skip before the next edge.
+     */
+    std::uint64_t skip(xoroshiro& r) const {
+        static constexpr double max_skip = 1ULL<<62;
+        if (p >= 1) return 0;
+        if (p <= 0) return max_skip;
+        double u = ((r() >> 11) + 1) * 0x1p-53;
+        double s = std::floor(std::log(u) / log_q);
+        return s < max_skip ? s : max_skip;
+    }
+
+    /**
+     * Expected amount of work to generate the nodes before n.
+     */
+    long double cost(std::uint64_t n) const {
+        return n + p * ((long double)n * (n-1) / 2);
+    }
+public:
+    static constexpr std::uint64_t edges_per_chunk = 1<<18;
+
+    erdos_source(std::uint64_t N, std::uint64_t M, std::uint64_t S=0): N(N), seed(S) {
+        if (N > 1ULL<<32) throw std::runtime_error("Too many nodes");
+        std::uint64_t pairs = N*(N-1)/2;
+        std::uint64_t tree = N ? N-1 : 0;
+        M = std::max(M, tree);
+        p = pairs > tree ? std::min(1.0, (double)(M - tree) / (pairs - tree)) : 0;
+        log_q = std::log1p(-p);
+        std::uint64_t chunks = std::max<std::uint64_t>(1, std::min<std::uint64_t>(tree, (M+N) / edges_per_chunk + 1));
+        long double total = cost(N);
+        first_node.push_back(1);
+        for (std::uint64_t c=1; c<chunks; c++) {
+            std::uint64_t lo = first_node.back(), hi = N;
+            while (lo < hi) {
+                std::uint64_t mid = lo + (hi-lo)/2;
+                if (cost(mid) * chunks < total * c) lo = mid+1;
+                else hi = mid;
+            }
+            first_node.push_back(lo);
+        }
+        first_node.push_back(std::max<std::uint64_t>(N, 1));
+    }
+
+    std::uint64_t nodes() const {
+        return N;
+    }
+
+    std::size_t chunks() const {
+        return first_node.size() - 1;
+    }
+
+    /**
+     * Calls emit(i, j), with j < i, for every edge of chunk c, ordered by i
+     * and then by j.
+     */
+    template<typename F>
+    void chunk(std::size_t c, F&& emit) const {
+        xoroshiro r = seeded_rng(seed, c);
+        std::uint64_t j = skip(r);
+        for (std::uint64_t i=first_node[c]; i<first_node[c+1]; i++) {
+            std::uint64_t parent = r(i);
+            bool parent_done = false;
+            for (; j < i; j += skip(r) + 1) {
+                if (!parent_done && parent <= j) {
+                    emit(i, parent);
+                    parent_done = true;
+                    if (parent == j) continue;
+                }
+                emit(i, j);
+            }
+            if (!parent_done) emit(i, parent);
+            j -= i;
+        }
+    }
+};
+
+/**
+ * Generates the chunks of source on nthreads threads (-1 means one per
+ * core) and calls f(edges) with the edges of each chunk, in chunk order.
+ * Only a few chunks per thread are kept in memory at any time, so a large
+ * graph can be written out as it is generated.
+ */
+template<typename Source, typename F>
+void stream_edges(const Source& source, int nthreads, F&& f) {
+    if (nthreads == -1) nthreads = std::thread::hardware_concurrency();
+    std::size_t window = 4 * std::max(nthreads, 1);
+    std::vector<edge_list_t> edges(window);
+    for (std::size_t first=0; first<source.chunks(); first+=window) {
+        std::size_t count = std::min(window, source.chunks() - first);
+        parallel_for(count, nthreads, [&] (std::uint64_t c) {
+            edges[c].clear();
+            source.chunk(first+c, [&] (std::uint64_t a, std::uint64_t b) {
+                edges[c].emplace_back(a, b);
+            });
+        });
+        for (std::size_t c=0; c<count; c++) f((const edge_list_t&)edges[c]);
     }
+}
+
+/**
+ * Returns all the edges of source, generated on nthreads threads (-1 means
+ * one per core) and listed in chunk order, so that the result does not
+ * depend on nthreads. expected_edges is only used to size the list.
+ */
+template<typename Source>
+edge_list_t collect_edges(const Source& source, int nthreads=-1, std::uint64_t expected_edges=0) {
+    edge_list_t ans;
+    ans.reserve(expected_edges);
+    stream_edges(source, nthreads, [&ans] (const edge_list_t& edges) {
+        ans.insert(ans.end(), edges.begin(), edges.end());
+    });
     return ans;
 }
 
+/**
+ * Generates a new random connected graph according to the Erdos-Renyi model
+ * (see erdos_source).
+ *
+ * N, M and S are, respectively, the number of nodes, the expected number of
+ * edges and the seed to use. If M is not at least N-1, it is increased
+ * accordingly.
+ */
+inline edge_list_t gen_conn_erdos(std::uint64_t N, std::uint64_t M, std::uint64_t S=0, int nthreads=-1) {
+    return collect_edges(erdos_source(N, M, S), nthreads, M + M/64);
+}
+
+/**
+ * Upper bound on the number of edges of a Barabasi-Albert graph: node i > 1
+ * connects to at most 2K nodes, and to at most the i nodes before it.
+ */
+inline std::uint64_t barabasi_albert_max_edges(std::uint64_t N, std::uint64_t K) {
+    if (N < 2) return 0;
+    std::uint64_t m = std::min(N, 2*K);
+    return m*(m-1)/2 + (N-m)*2*K;
+}
+
 /**
  * Variant of Barabasi-Albert's algorithm to generate a scale-free network.
  *
  * N, K and S are, respectively, the number of nodes of the network,
  * a factor proportional to the connectivity of the network (choose K=1 to
  * have the original algorithm) and the seed.
+ *
+ * Every new node chooses K distinct existing edges at random (all of them,
+ * if there are at most K) and connects to both endpoints of each, so nodes
+ * are chosen with probability proportional to their degree. The edge list
+ * itself is the array of endpoints of Batagelj and Brandes' algorithm, and
+ * the edges a node picked are kept in a small hash table to reject repeated
+ * picks, so each node takes O(K log K) time (for sorting its neighbours).
+ * K must be at least 1.
  */
-inline edge_list_t gen_barabasi_albert(int N, int K, int S=0) {
+inline edge_list_t gen_barabasi_albert(std::uint64_t N, int K, std::uint64_t S=0) {
+    if (K < 1) throw std::invalid_argument("Barabasi-Albert graphs need K >= 1");
     edge_list_t ans;
+    if (N < 2) return ans;
+    xoroshiro r = seeded_rng(S, 0);
+    std::vector<std::size_t> picked(K);
+    std::vector<std::size_t> neighs(2*K);
+    // Open addressing table of the edges picked by node owner[h], at most
+    // half full, so that it never needs to be cleared.
+    std::size_t mask = 1;
+    while (mask < 2*(std::size_t)K) mask = 2*mask+1;
+    std::vector<std::size_t> table(mask+1);
+    std::vector<std::uint64_t> owner(mask+1, 0);
+    ans.reserve(barabasi_albert_max_edges(N, K));
     ans.emplace_back(1, 0);
-    for (int i=2; i<N; i++) {
-        std::vector<std::size_t> neighs;
-        for (auto idx: rng.get_distinct(K, ans.size())) {
-            neighs.emplace_back(ans[idx].first);
-            neighs.emplace_back(ans[idx].second);
+    for (std::uint64_t i=2; i<N; i++) {
+        std::size_t edges = ans.size();
+        std::size_t num_picked = 0;
+        if ((std::size_t)K >= edges) {
+            for (std::size_t e=0; e<edges; e++) picked[num_picked++] = e;
+        } else {
+            while (num_picked < (std::size_t)K) {
+                std::size_t e = r(edges);
+                std::size_t h = (e * 0x9E3779B97F4A7C15ULL >> 32) & mask;
+                while (owner[h] == i && table[h] != e) h = (h+1) & mask;
+                if (owner[h] == i) continue;
+                owner[h] = i;
+                table[h] = e;
+                picked[num_picked++] = e;
+            }
+        }
+        std::size_t num_neighs = 0;
+        for (std::size_t k=0; k<num_picked; k++) {
+            neighs[num_neighs++] = ans[picked[k]].first;
+            neighs[num_neighs++] = ans[picked[k]].second;
         }
-        std::sort(neighs.begin(), neighs.end());
-        neighs.erase(std::unique(neighs.begin(), neighs.end()), neighs.end());
-        for (auto neigh: neighs) {
-            ans.emplace_back(i, neigh);
+        std::sort(neighs.begin(), neighs.begin()+num_neighs);
+        auto last = std::unique(neighs.begin(), neighs.begin()+num_neighs);
+        for (auto neigh=neighs.begin(); neigh!=last; neigh++) {
+            ans.emplace_back(i, *neigh);
         }
     }
     return ans;
 }
 
+/**
+ * Edges of an approximation of gen_barabasi_albert that can be generated in
+ * parallel chunks, in the same way as erdos_source.
+ *
+ * Every node i > 1 is given exactly 2K edge slots, so that the position of
+ * any slot is known in advance: slots 2k and 2k+1 of node i hold the two
+ * endpoints of the k-th edge slot it picked, uniformly among the slots of the
+ * nodes before it. The endpoint in a slot is found by following its picks
+ * back, which takes two steps on average, using generators seeded from S and
+ * the node so that they can be replayed. Each node then connects to the
+ * distinct endpoints of its slots. Unlike gen_barabasi_albert, picks may
+ * repeat and duplicate endpoints still count towards the degree weight of a
+ * node, which makes little difference once the graph has more than a few
+ * nodes. K must be at least 1.
+ */
+class barabasi_albert_source {
+    std::uint64_t N;
+    std::uint64_t K;
+    std::uint64_t seed;
+
+    static constexpr std::uint64_t nodes_per_chunk = 1<<15;
+
+    /**
+     * First slot of node i > 1; slot 0 is the edge between nodes 1 and 0.
+     */
+    std::uint64_t first_slot(std::uint64_t i) const {
+        return 1 + 2*K*(i-2);
+    }
+
+    std::uint64_t owner(std::uint64_t slot) const {
+        return slot == 0 ? 1 : 2 + (slot-1) / (2*K);
+    }
+
+    /**
+     * Returns the K slots picked by node i.
+     */
+    void picks(std::uint64_t i, std::uint64_t* out) const {
+        xoroshiro r = seeded_rng(seed, i);
+        std::uint64_t slots = first_slot(i);
+        for (std::uint64_t k=0; k<K; k++) out[k] = r(slots);
+    }
+
+    /**
+     * Returns the endpoint, other than the owner, of the edge in the given
+     * slot.
+     */
+    std::uint64_t target(std::uint64_t slot, std::uint64_t* buf) const {
+        while (slot != 0) {
+            std::uint64_t i = owner(slot);
+            std::uint64_t pos = slot - first_slot(i);
+            picks(i, buf);
+            slot = buf[pos/2];
+            if (pos % 2 == 0) return owner(slot);
+        }
+        return 0;
+    }
+public:
+    barabasi_albert_source(std::uint64_t N, int K, std::uint64_t S=0): N(N), K(K), seed(S) {
+        if (K < 1) throw std::invalid_argument("Barabasi-Albert graphs need K >= 1");
+    }
+
+    std::uint64_t nodes() const {
+        return N;
+    }
+
+    std::size_t chunks() const {
+        return (N + nodes_per_chunk - 1) / nodes_per_chunk;
+    }
+
+    /**
+     * Calls emit(i, j), with j < i, for every edge of chunk c, ordered by i
+     * and then by j.
+     */
+    template<typename F>
+    void chunk(std::size_t c, F&& emit) const {
+        std::vector<std::uint64_t> own(K), other(K), neighs(2*K);
+        std::uint64_t last = std::min(N, (c+1)*nodes_per_chunk);
+        for (std::uint64_t i=std::max<std::uint64_t>(c*nodes_per_chunk, 1); i<last; i++) {
+            if (i == 1) {
+                emit(1, 0);
+                continue;
+            }
+            picks(i, own.data());
+            for (std::uint64_t k=0; k<K; k++) {
+                neighs[2*k] = owner(own[k]);
+                neighs[2*k+1] = target(own[k], other.data());
+            }
+            std::sort(neighs.begin(), neighs.end());
+            auto end = std::unique(neighs.begin(), neighs.end());
+            for (auto neigh=neighs.begin(); neigh!=end; neigh++) emit(i, *neigh);
+        }
+    }
+};
+
+/**
+ * Generates a scale-free network with barabasi_albert_source on nthreads
+ * threads (-1 means one per core). The result does not depend on nthreads.
+ */
+inline edge_list_t gen_barabasi_albert_parallel(std::uint64_t N, int K, std::uint64_t S=0, int nthreads=-1) {
+    return collect_edges(barabasi_albert_source(N, K, S), nthreads, barabasi_albert_max_edges(N, K));
+}
+
+/**
+ * Edges of a Watts-Strogatz small-world graph, in parallel chunks as in
+ * erdos_source.
+ *
+ * Nodes are placed on a ring and node i is connected to the K nodes that
+ * follow it; each of these edges is then replaced, with probability beta, by
+ * an edge from i to a random node that is not within distance K of i on the
+ * ring and that i is not already connected to. The choices of a node only
+ * depend on S and the node, so that a node that rewired an edge to j can
+ * check whether j also rewired an edge to it, and the edge is produced once.
+ */
+class watts_strogatz_source {
+    std::uint64_t N;
+    std::uint64_t K;
+    double beta;
+    std::uint64_t seed;
+    std::uint64_t nodes_per_chunk;
+
+    std::uint64_t ring_distance(std::uint64_t a, std::uint64_t b) const {
+        std::uint64_t d = a > b ? a-b : b-a;
+        return std::min(d, N-d);
+    }
+
+    /**
+     * Sets targets[d-1] to the node that the edge from i to i+d goes to, and
+     * rewired[d-1] to whether it was rewired.
+     */
+    void targets(std::uint64_t i, std::uint64_t* targets, bool* rewired) const {
+        xoroshiro r = seeded_rng(seed, i);
+        std::uint64_t candidates = N - 1 - 2*K;
+        for (std::uint64_t d=1; d<=K; d++) {
+            targets[d-1] = (i+d) % N;
+            rewired[d-1] = false;
+            bool rewire = (r() >> 11) * 0x1p-53 < beta;
+            if (!rewire || candidates == 0) continue;
+            candidates--;
+            while (true) {
+                std::uint64_t j = r(N);
+                if (ring_distance(i, j) <= K) continue;
+                bool taken = false;
+                for (std::uint64_t e=0; e<d-1; e++)
+                    taken |= rewired[e] && targets[e] == j;
+                if (taken) continue;
+                targets[d-1] = j;
+                rewired[d-1] = true;
+                break;
+            }
+        }
+    }
+public:
+    static constexpr std::uint64_t edges_per_chunk = 1<<18;
+
+    watts_strogatz_source(std::uint64_t N, int K, double beta, std::uint64_t S=0):
+        N(N), K(N ? std::min<std::uint64_t>(std::max(K, 0), (N-1)/2) : 0), beta(beta), seed(S),
+        nodes_per_chunk(std::max<std::uint64_t>(1, edges_per_chunk / std::max(K, 1))) {}
+
+    std::uint64_t nodes() const {
+        return N;
+    }
+
+    std::size_t chunks() const {
+        return (N + nodes_per_chunk - 1) / nodes_per_chunk;
+    }
+
+    /**
+     * Calls emit(i, j) for every edge of chunk c, in the order of i.
+     */
+    template<typename F>
+    void chunk(std::size_t c, F&& emit) const {
+        std::vector<std::uint64_t> own(K), other(K);
+        std::unique_ptr<bool[]> own_rewired(new bool[K]), other_rewired(new bool[K]);
+        std::uint64_t last = std::min(N, (c+1)*nodes_per_chunk);
+        for (std::uint64_t i=c*nodes_per_chunk; i<last; i++) {
+            targets(i, own.data(), own_rewired.get());
+            for (std::uint64_t e=0; e<K; e++) {
+                std::uint64_t j = own[e];
+                if (own_rewired[e] && j < i) {
+                    targets(j, other.data(), other_rewired.get());
+                    bool both = false;
+                    for (std::uint64_t f=0; f<K; f++)
+                        both |= other_rewired[f] && other[f] == i;
+                    if (both) continue;
+                }
+                emit(i, j);
+            }
+        }
+    }
+};
+
+/**
+ * Edges of a random graph in which every node has degree D, up to the self
+ * loops and repeated edges of the pairing model, which are dropped (there
+ * are about (D-1)^2/4 of them on average, whatever the number of nodes).
+ *
+ * Each node has D stubs, and the stubs are paired in the order of a random
+ * permutation: since the permutation can be inverted at any point, each node
+ * finds the partners of its stubs on its own, and the graph is produced in
+ * parallel chunks as in erdos_source.
+ */
+class random_regular_source {
+    std::uint64_t N;
+    std::uint64_t D;
+    random_permutation order;
+    std::uint64_t nodes_per_chunk;
+public:
+    static constexpr std::uint64_t edges_per_chunk = 1<<18;
+
+    random_regular_source(std::uint64_t N, int D, std::uint64_t S=0):
+        N(N), D(std::max(D, 0)), order(N*this->D, S),
+        nodes_per_chunk(std::max<std::uint64_t>(1, edges_per_chunk / std::max(D, 1))) {}
+
+    std::uint64_t nodes() const {
+        return N;
+    }
+
+    std::size_t chunks() const {
+        return (N + nodes_per_chunk - 1) / nodes_per_chunk;
+    }
+
+    /**
+     * Calls emit(i, j), with j < i, for every edge of chunk c, ordered by i
+     * and then by j.
+     */
+    template<typename F>
+    void chunk(std::size_t c, F&& emit) const {
+        std::vector<std::uint64_t> neighs;
+        std::uint64_t last = std::min(N, (c+1)*nodes_per_chunk);
+        for (std::uint64_t i=c*nodes_per_chunk; i<last; i++) {
+            neighs.clear();
+            for (std::uint64_t stub=i*D; stub<(i+1)*D; stub++) {
+                // With an odd number of stubs, the last one stays unpaired.
+                std::uint64_t partner = order.inverse(stub) ^ 1;
+                if (partner >= N*D) continue;
+                std::uint64_t j = order(partner) / D;
+                if (j < i) neighs.push_back(j);
+            }
+            std::sort(neighs.begin(), neighs.end());
+            auto end = std::unique(neighs.begin(), neighs.end());
+            for (auto j=neighs.begin(); j!=end; j++) emit(i, *j);
+        }
+    }
+};
+
+/**
+ * Edges of an undirected R-MAT graph: M edges are dropped in the adjacency
+ * matrix, choosing recursively the quadrant of the matrix with probabilities
+ * a (top left), b (top right), c (bottom left) and 1-a-b-c.
+ *
+ * Only cells below the diagonal are used, so quadrants above the diagonal
+ * and outside the N nodes are skipped, and the probabilities of the others
+ * scaled. Rather than following each edge, the number of edges in each
+ * quadrant is drawn from a binomial distribution, so edges that fall in the
+ * same cell are found together and give a single edge: the graph has at most
+ * M edges, and fewer when the matrix is skewed. The squares of a level of
+ * the recursion, with their number of edges, are the chunks, and node ids
+ * are shuffled so that degrees do not decrease with the id.
+ */
+class rmat_source {
+    struct square {
+        std::uint64_t row;
+        std::uint64_t col;
+        int level;
+        std::uint64_t edges;
+    };
+
+    std::uint64_t N;
+    double prob[4];
+    std::uint64_t seed;
+    random_permutation ids;
+    std::vector<square> squares;
+
+    /**
+     * Returns true if a square has a cell below the diagonal and within the
+     * nodes.
+     */
+    bool valid(std::uint64_t row, std::uint64_t col, int level) const {
+        if (row >= N || col >= N) return false;
+        if (row != col) return row > col;
+        return level > 0 && row+1 < N;
+    }
+
+    /**
+     * Divides the edges of s among its quadrants, and calls f on those that
+     * have some.
+     */
+    template<typename F>
+    void split(const square& s, xoroshiro& r, F&& f) const {
+        std::uint64_t half = 1ULL << (s.level-1);
+        square quadrants[4] = {
+            {s.row, s.col, s.level-1, 0},
+            {s.row, s.col+half, s.level-1, 0},
+            {s.row+half, s.col, s.level-1, 0},
+            {s.row+half, s.col+half, s.level-1, 0}
+        };
+        double weight[4];
+        double total = 0;
+        for (int q=0; q<4; q++) {
+            weight[q] = valid(quadrants[q].row, quadrants[q].col, quadrants[q].level) ? prob[q] : 0;
+            total += weight[q];
+        }
+        std::uint64_t left = s.edges;
+        for (int q=0; q<4 && left; q++) {
+            if (weight[q] == 0) continue;
+            std::uint64_t n = left;
+            if (weight[q] < total) n = std::binomial_distribution<std::uint64_t>(left, weight[q] / total)(r);
+            total -= weight[q];
+            left -= n;
+            quadrants[q].edges = n;
+            if (n) f(quadrants[q]);
+        }
+    }
+
+    /**
+     * Follows a single edge from s down to its cell.
+     */
+    std::pair<std::uint64_t, std::uint64_t> descend(square s, xoroshiro& r) const {
+        while (s.level > 0) {
+            std::uint64_t half = 1ULL << (s.level-1);
+            double weight[4];
+            double total = 0;
+            for (int q=0; q<4; q++) {
+                weight[q] = valid(s.row + (q/2)*half, s.col + (q%2)*half, s.level-1) ? prob[q] : 0;
+                total += weight[q];
+            }
+            double u = (r() >> 11) * 0x1p-53 * total;
+            int q = 0;
+            while (q < 3 && (weight[q] == 0 || u >= weight[q])) u -= weight[q++];
+            while (weight[q] == 0) q--;
+            s.row += (q/2)*half;
+            s.col += (q%2)*half;
+            s.level--;
+        }
+        return {s.row, s.col};
+    }
+
+    template<typename F>
+    void generate(const square& s, xoroshiro& r, F&& emit) const {
+        // Drawing binomials costs more than following a few edges one by
+        // one and removing the repeated cells.
+        static constexpr std::uint64_t few_edges = 32;
+        if (s.level == 0 || s.edges <= few_edges) {
+            std::pair<std::uint64_t, std::uint64_t> cells[few_edges];
+            std::uint64_t n = s.level == 0 ? 1 : s.edges;
+            for (std::uint64_t e=0; e<n; e++) cells[e] = descend(s, r);
+            std::sort(cells, cells+n);
+            auto end = std::unique(cells, cells+n);
+            for (auto cell=cells; cell!=end; cell++) {
+                std::uint64_t a = ids(cell->first), b = ids(cell->second);
+                emit(std::max(a, b), std::min(a, b));
+            }
+            return;
+        }
+        split(s, r, [&] (const square& q) { generate(q, r, emit); });
+    }
+public:
+    static constexpr std::uint64_t edges_per_chunk = 1<<18;
+
+    rmat_source(std::uint64_t N, std::uint64_t M, std::uint64_t S=0, double a=0.57, double b=0.19, double c=0.19):
+        N(N), prob{a, b, c, 1-a-b-c}, seed(S), ids(N, S) {
+        if (a < 0 || b < 0 || c < 0 || a+b+c > 1) throw std::runtime_error("Invalid R-MAT probabilities");
+        if (N > 1ULL<<32) throw std::runtime_error("Too many nodes");
+        int scale = 0;
+        while ((1ULL << scale) < N) scale++;
+        if (!valid(0, 0, scale) || M == 0) return;
+        squares.push_back({0, 0, scale, M});
+        xoroshiro r = seeded_rng(S, 0);
+        while (squares[0].level > 0 && squares.size() * edges_per_chunk < M) {
+            std::vector<square> next;
+            for (const square& s: squares)
+                split(s, r, [&next] (const square& q) { next.push_back(q); });
+            squares.swap(next);
+        }
+    }
+
+    std::uint64_t nodes() const {
+        return N;
+    }
+
+    std::size_t chunks() const {
+        return squares.size();
+    }
+
+    /**
+     * Calls emit(i, j), with j < i, for every edge of chunk c.
+     */
+    template<typename F>
+    void chunk(std::size_t c, F&& emit) const {
+        xoroshiro r = seeded_rng(seed, c+1);
+        generate(squares[c], r, emit);
+    }
+};
+
+/**
+ * Edges of a random geometric graph: N points are placed uniformly at random
+ * in the unit square, and two nodes are connected if their points are
+ * closer than the radius that gives an average degree of K (a bit less,
+ * because of the border).
+ *
+ * The square is divided in cells at least as large as the radius, and the
+ * number of points of each cell is drawn when the source is created, so that
+ * the points of any cell can be generated again from S and the cell. Nodes
+ * are numbered cell by cell, in row order, and each chunk covers some rows
+ * of cells, generating the points of the row before them too.
+ */
+class geometric_source {
+    std::uint64_t N;
+    double radius;
+    std::uint64_t grid;
+    std::uint64_t seed;
+    std::uint64_t rows_per_chunk;
+    // Nodes of cell c are numbered from first_node[c] to first_node[c+1]
+    // (exclusive).
+    std::vector<std::uint64_t> first_node;
+
+    void points(std::uint64_t cell, std::vector<double>& x, std::vector<double>& y, std::uint64_t first) const {
+        xoroshiro r = seeded_rng(seed, cell+1);
+        double x0 = 1.0 * (cell % grid) / grid, y0 = 1.0 * (cell / grid) / grid;
+        for (std::uint64_t n=first_node[cell]; n<first_node[cell+1]; n++) {
+            x[n-first] = x0 + (r() >> 11) * 0x1p-53 / grid;
+            y[n-first] = y0 + (r() >> 11) * 0x1p-53 / grid;
+        }
+    }
+public:
+    static constexpr std::uint64_t edges_per_chunk = 1<<18;
+
+    geometric_source(std::uint64_t N, int K, std::uint64_t S=0): N(N), seed(S) {
+        radius = N ? std::sqrt(std::max(K, 0) / (M_PI * N)) : 0;
+        grid = 1;
+        while (grid < N && (grid+1) * (grid+1) <= N && (grid+1) * radius <= 1) grid++;
+        first_node.resize(grid*grid+1);
+        xoroshiro r = seeded_rng(S, 0);
+        std::uint64_t left = N;
+        for (std::uint64_t cell=0; cell<grid*grid; cell++) {
+            std::uint64_t n = left;
+            if (cell+1 < grid*grid) n = std::binomial_distribution<std::uint64_t>(left, 1.0 / (grid*grid-cell))(r);
+            first_node[cell+1] = first_node[cell] + n;
+            left -= n;
+        }
+        double edges_per_row = 0.5 * N * std::max(K, 1) / grid;
+        rows_per_chunk = std::max<std::uint64_t>(1, edges_per_chunk / std::max(edges_per_row, 1.0));
+    }
+
+    std::uint64_t nodes() const {
+        return N;
+    }
+
+    std::size_t chunks() const {
+        return (grid + rows_per_chunk - 1) / rows_per_chunk;
+    }
+
+    /**
+     * Calls emit(i, j), with j < i, for every edge of chunk c, in the order
+     * of i.
+     */
+    template<typename F>
+    void chunk(std::size_t c, F&& emit) const {
+        std::uint64_t first_row = c*rows_per_chunk;
+        std::uint64_t last_row = std::min(grid, (c+1)*rows_per_chunk);
+        // Nodes only look for neighbours with smaller ids, which are in the
+        // same row or in the one before.
+        std::uint64_t low = first_row ? first_row-1 : 0;
+        std::uint64_t first = first_node[low*grid];
+        std::vector<double> x(first_node[last_row*grid] - first), y(x.size());
+        for (std::uint64_t cell=low*grid; cell<last_row*grid; cell++) points(cell, x, y, first);
+        double r2 = radius * radius;
+        for (std::uint64_t row=first_row; row<last_row; row++) {
+            for (std::uint64_t col=0; col<grid; col++) {
+                std::uint64_t cell = row*grid + col;
+                for (std::uint64_t i=first_node[cell]; i<first_node[cell+1]; i++) {
+                    for (std::uint64_t nrow=row?row-1:0; nrow<=row; nrow++) {
+                        // Cells of the next row, and after this one in the
+                        // same row, have larger ids.
+                        std::uint64_t last_col = nrow == row ? col : std::min(grid-1, col+1);
+                        for (std::uint64_t ncol=col?col-1:0; ncol<=last_col; ncol++) {
+                            std::uint64_t ncell = nrow*grid + ncol;
+                            std::uint64_t end = std::min(first_node[ncell+1], i);
+                            for (std::uint64_t j=first_node[ncell]; j<end; j++) {
+                                double dx = x[i-first] - x[j-first], dy = y[i-first] - y[j-first];
+                                if (dx*dx + dy*dy <= r2) emit(i, j);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
+
+/**
+ * Parameters of the generators that take more than one.
+ */
+struct generator_options {
+    // Probability of rewiring an edge, for watts_strogatz.
+    double rewiring = 0.1;
+    // Probabilities of the top left, top right and bottom left quadrants,
+    // for rmat.
+    double rmat_a = 0.57;
+    double rmat_b = 0.19;
+    double rmat_c = 0.19;
+};
+
+/**
+ * Names of the generators known to with_generator.
+ */
+static const char* const generator_names = "erdos, barabasi_parallel, watts_strogatz, regular, rmat, geometric";
+
+/**
+ * Calls f with the source of the generator with the given name, for N nodes,
+ * seed S and main parameter par (the expected number of edges for erdos and
+ * the number of draws for rmat, K for barabasi_parallel and watts_strogatz,
+ * the degree for regular and the average degree for geometric). Returns
+ * false if there is no generator with that name.
+ */
+template<typename F>
+bool with_generator(const std::string& name, std::uint64_t N, std::uint64_t par, std::uint64_t S,
+                    const generator_options& options, F&& f) {
+    if (name == "erdos") f(erdos_source(N, par, S));
+    else if (name == "barabasi_parallel") f(barabasi_albert_source(N, par, S));
+    else if (name == "watts_strogatz") f(watts_strogatz_source(N, par, options.rewiring, S));
+    else if (name == "regular") f(random_regular_source(N, par, S));
+    else if (name == "rmat") f(rmat_source(N, par, S, options.rmat_a, options.rmat_b, options.rmat_c));
+    else if (name == "geometric") f(geometric_source(N, par, S));
+    else return false;
+    return true;
+}
+
 #endif
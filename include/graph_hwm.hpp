@@ -1,35 +1,239 @@
 #ifndef DISTSIM_GRAPH_HWM_HPP
 #define DISTSIM_GRAPH_HWM_HPP
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 #include "hardware_manager.hpp"
-#include "cuckoo.hpp"
+#include "small_set.hpp"
+#include "concurrent_cuckoo.hpp"
+#include "link_model.hpp"
 
+/**
+ * A hardware manager whose nodes can only send messages to their neighbours
+ * in a graph.
+ *
+ * The graph can be changed while the workers run. Every node's adjacency
+ * set is immutable once published: edge updates copy it, change the copy,
+ * swap it in and retire the old one through the manager's epochs, so that
+ * readers never take locks. Updates of different nodes proceed in parallel;
+ * the two directions of an undirected edge are updated one after the other.
+ * While the manager is not running, updates are done in place.
+ */
 template <typename T, bool directed = false>
 class GraphHardwareManager: public HardwareManager<T> {
+public:
+    typedef std::pair<node_id_t, node_id_t> edge_t;
 private:
-    std::vector<cuckoo_hash_set<node_id_t>> graph;
+    // Most nodes of power-law graphs have a handful of neighbours, which
+    // small_set keeps inline; hubs get a hash set.
+    typedef small_set<node_id_t> adjacency_t;
+    typedef typename HardwareManager<T>::epoch_guard epoch_guard;
+
+    // The adjacency sets are reached through a table of pointers split in
+    // segments of doubling size, which never move once allocated, so that
+    // nodes can be added while workers read the graph.
+    static const int first_segment_bits = 10;
+    static const int max_segments = 64 - first_segment_bits;
+    std::atomic<std::atomic<adjacency_t*>*> segments[max_segments] = {};
+    std::atomic<std::size_t> num_nodes{0};
+    std::mutex nodes_mutex;
+
+    static const int lock_stripes = 64;
+    std::mutex stripes[lock_stripes];
+    // Edges that were removed and not added back, so that messages sent on
+    // them can be told apart from messages sent on edges that never existed.
+    concurrent_cuckoo_hash_set<std::uint64_t> removed_edges;
+    std::atomic<std::uint64_t> severed{0};
+
+    LinkTable<directed> links;
+
+    // With a node order, the i-th node added is node order[i], and its
+    // adjacency set is in slot i; position is the inverse of order. Nodes
+    // beyond the order are in the slot of their own id.
+    std::vector<node_id_t> order, position;
+
+    /**
+     * Packs an edge in a key of removed_edges. Distinct edges only get
+     * the same key if node ids do not fit in 32 bits.
+     */
+    static std::uint64_t edge_key(node_id_t a, node_id_t b) {
+        if (!directed && a > b) std::swap(a, b);
+        return (std::uint64_t)a << 32 ^ b;
+    }
+
+    /**
+     * Returns the slot of a node.
+     */
+    node_id_t slot_index(node_id_t id) const {
+        return id < position.size() ? position[id] : id;
+    }
+
+    /**
+     * Returns the node whose adjacency set is in a slot.
+     */
+    node_id_t slot_node(node_id_t index) const {
+        return index < order.size() ? order[index] : index;
+    }
+
+    /**
+     * Returns true if the node was added.
+     */
+    bool added(node_id_t id) const {
+        return slot_index(id) < num_nodes.load(std::memory_order_acquire);
+    }
+
+    std::atomic<adjacency_t*>& slot_at(node_id_t index) const {
+        std::uint64_t x = index + (1ULL << first_segment_bits);
+        int msb = 63 - __builtin_clzll(x);
+        return segments[msb - first_segment_bits].load(std::memory_order_acquire)[x - (1ULL << msb)];
+    }
+
+    std::atomic<adjacency_t*>& slot(node_id_t id) const {
+        return slot_at(slot_index(id));
+    }
+
+    /**
+     * Publishes the adjacency set of the next node, returning its id.
+     * Called with nodes_mutex held.
+     */
+    node_id_t new_slot(adjacency_t* adj) {
+        node_id_t index = num_nodes;
+        std::uint64_t x = index + (1ULL << first_segment_bits);
+        int segment = 63 - __builtin_clzll(x) - first_segment_bits;
+        if (segments[segment].load() == nullptr)
+            segments[segment] = new std::atomic<adjacency_t*>[1ULL << (segment + first_segment_bits)];
+        slot_at(index).store(adj, std::memory_order_relaxed);
+        num_nodes.store(index+1, std::memory_order_release);
+        return slot_node(index);
+    }
+
+    /**
+     * Returns the worker that builds the state of node n in add_nodes and
+     * add_graph: the one it is assigned to, or one by id for the others.
+     */
+    int builder(node_id_t n) const {
+        int w = this->home_worker(n);
+        return w >= 0 ? w : n % this->worker_count();
+    }
+
+    /**
+     * Returns the current adjacency set of n. Must be called inside a
+     * critical section of the manager's epochs.
+     */
+    const adjacency_t& adjacency(node_id_t n) const {
+        if (!added(n)) throw std::runtime_error("Invalid node");
+        return *slot(n).load(std::memory_order_acquire);
+    }
+
+    /**
+     * Applies change to the adjacency set of n.
+     */
+    template<typename F>
+    void update(node_id_t n, F&& change) {
+        std::lock_guard<std::mutex> lck(stripes[n % lock_stripes]);
+        auto& s = slot(n);
+        adjacency_t* old = s.load(std::memory_order_relaxed);
+        if (!this->is_running()) {
+            change(*old);
+            return;
+        }
+        adjacency_t* copy = new adjacency_t(*old);
+        change(*copy);
+        s.store(copy, std::memory_order_release);
+        this->epochs.retire([old] () {delete old;});
+    }
+
+    /**
+     * Adds or removes a batch of edges, copying every adjacency set that
+     * changes only once.
+     */
+    void update_edges(const std::vector<edge_t>& edges, bool add) {
+        std::vector<edge_t> half_edges;
+        half_edges.reserve(edges.size() * (directed ? 1 : 2));
+        for (const auto& [a, b]: edges) {
+            if (!added(a) || !added(b)) throw std::runtime_error("Invalid node in edge!");
+            half_edges.emplace_back(a, b);
+            if (!directed) half_edges.emplace_back(b, a);
+        }
+        std::sort(half_edges.begin(), half_edges.end());
+        // Edges are marked as removed before they disappear from the
+        // adjacency, and unmarked after they are back, so that a sender
+        // never finds an edge missing and unmarked.
+        if (!add) for (const auto& [a, b]: edges) removed_edges.insert(edge_key(a, b));
+        for (std::size_t i=0; i<half_edges.size(); ) {
+            std::size_t j = i;
+            while (j < half_edges.size() && half_edges[j].first == half_edges[i].first) j++;
+            update(half_edges[i].first, [&] (adjacency_t& adj) {
+                if (add) {
+                    std::vector<node_id_t> targets;
+                    targets.reserve(j-i);
+                    for (std::size_t k=i; k<j; k++) targets.push_back(half_edges[k].second);
+                    adj.insert_many(targets);
+                    return;
+                }
+                for (std::size_t k=i; k<j; k++) adj.erase(half_edges[k].second);
+            });
+            i = j;
+        }
+        if (add && !removed_edges.empty())
+            for (const auto& [a, b]: edges) removed_edges.erase(edge_key(a, b));
+    }
 public:
     GraphHardwareManager(int nt, uint64_t seed): HardwareManager<T>(0, nt, seed) {}
+
     /**
      * Check if a can send to b
      */
     bool can_send(node_id_t a, node_id_t b) const override {
-        return graph[a].count(b);
+        epoch_guard g(this->epochs);
+        return adjacency(a).count(b);
+    }
+
+    /**
+     * Checks the edge and applies the parameters of its link to the message,
+     * drawing a single random number for both loss and jitter. A message
+     * sent on an edge that was removed is counted as severed instead of
+     * raising an error.
+     */
+    bool transmit(node_id_t a, node_id_t b, Message<T>& msg) override {
+        if (!can_send(a, b)) {
+            if (removed_edges.empty() || !removed_edges.count(edge_key(a, b)))
+                throw std::runtime_error("The sender cannot send to the receiver!");
+            severed++;
+            return false;
+        }
+        if (links.empty()) return true;
+        const LinkParams& link = links.get(a, b);
+        std::uint64_t r = rng();
+        if (link.lost(r)) return false;
+        this->set_link_delay(msg, link.delay(r, msg.size()));
+        return true;
     }
 
     /**
      * Iterate on n's neighbours, executing callback for every neighbour found.
      * If the callback returns true the iteration continues, otherwise
-     * the iteration ends.
+     * the iteration ends. The iteration sees the neighbours n had when it
+     * started.
      */
     void iter_neighbours(
         node_id_t n,
         const std::function<bool(node_id_t)>& callback
     ) const override {
-        for (auto& node: graph[n]) {
+        epoch_guard g(this->epochs);
+        for (auto& node: adjacency(n)) {
             if (!callback(node)) break;
         }
     };
 
+    /**
+     * Return the number of n's neighbours.
+     */
+    std::size_t count_neighbours(node_id_t n) const override {
+        epoch_guard g(this->epochs);
+        return adjacency(n).size();
+    }
+
     /**
      * Generate a new id. As a new node gets its ID as the number of
      * nodes present in the graph when it was inserted, this function
@@ -40,19 +244,70 @@ public:
     }
 
     /**
-     * Returns a random node id.
+     * Returns the number of nodes that were added, including the ones
+     * that failed.
+     */
+    std::size_t graph_size() const {
+        return num_nodes;
+    }
+
+    /**
+     * Returns a random node id, skipping the nodes that failed.
      */
-    node_id_t get_random_node() {
-        return rng() % graph.size();
+    node_id_t get_random_node() override {
+        if (HardwareManager<T>::size() == 0) throw std::runtime_error("Empty node list");
+        node_id_t id = slot_node(rng() % graph_size());
+        while (!this->has_node(id)) id = slot_node(rng() % graph_size());
+        return id;
     }
 
     /**
-     * Add a single node.
+     * Add a single node. It is safe to call this while the workers are
+     * running.
      */
     template<typename node_t, typename... Args>
     void add_node(Args... args) {
-        HardwareManager<T>::add_node(std::move(std::make_unique<node_t>(this, graph.size(), args...)));
-        graph.emplace_back();
+        std::lock_guard<std::mutex> lck(nodes_mutex);
+        node_id_t id = new_slot(new adjacency_t);
+        HardwareManager<T>::add_node(std::move(std::make_unique<node_t>(this, id, args...)));
+    }
+
+    /**
+     * Adds count nodes, creating the one with id i as make(i), which returns
+     * a std::unique_ptr to a Node<T>. If the workers are pinned, nodes and
+     * their adjacency sets are created by threads placed as their worker
+     * (see on_workers), so that the memory of every partition is on the
+     * NUMA node that handles it; nodes are then initialized in the order
+     * of their slots. make is then called concurrently, so it (and the
+     * constructors of the nodes) must be thread safe. Otherwise nodes are
+     * created on this thread, in the node order if one was set. Cannot be
+     * called while the manager is running.
+     */
+    template<typename F>
+    void add_nodes(std::size_t count, F&& make) {
+        if (this->is_running()) throw std::runtime_error("Cannot add nodes in bulk while running");
+        std::lock_guard<std::mutex> lck(nodes_mutex);
+        node_id_t first = num_nodes;
+        std::vector<std::unique_ptr<Node<T>>> made(count);
+        std::vector<std::unique_ptr<adjacency_t>> adjacencies(count);
+        if (this->workers_pinned()) {
+            this->on_workers([&] (int w) {
+                for (std::size_t i=0; i<count; i++) {
+                    node_id_t id = slot_node(first + i);
+                    if (builder(id) != w) continue;
+                    adjacencies[i] = std::make_unique<adjacency_t>();
+                    made[i] = make(id);
+                }
+            });
+        }
+        for (std::size_t i=0; i<count; i++) {
+            if (!made[i]) {
+                adjacencies[i] = std::make_unique<adjacency_t>();
+                made[i] = make(slot_node(first + i));
+            }
+            new_slot(adjacencies[i].release());
+            HardwareManager<T>::add_node(std::move(made[i]));
+        }
     }
 
     /**
@@ -60,9 +315,181 @@ public:
      * in both directions otherwise.
      */
     void add_edge(node_id_t a, node_id_t b) {
-        if (a >= graph.size() || b >= graph.size()) throw std::runtime_error("Invalid node in edge!");
-        graph[a].insert(b);
-        if (!directed) graph[b].insert(a);
+        if (!added(a) || !added(b)) throw std::runtime_error("Invalid node in edge!");
+        update(a, [b] (adjacency_t& adj) {adj.insert(b);});
+        if (!directed) update(b, [a] (adjacency_t& adj) {adj.insert(a);});
+        if (!removed_edges.empty()) removed_edges.erase(edge_key(a, b));
+    }
+
+    /**
+     * Add a single edge with its own link parameters. Link parameters can
+     * only be set while the manager is not running.
+     */
+    void add_edge(node_id_t a, node_id_t b, const LinkParams& params) {
+        if (this->is_running()) throw std::runtime_error("Cannot change links while running");
+        add_edge(a, b);
+        links.set(a, b, params);
+    }
+
+    /**
+     * Removes a single edge, in both directions if the graph is undirected.
+     * Returns false if there was no such edge.
+     */
+    bool remove_edge(node_id_t a, node_id_t b) {
+        if (!added(a) || !added(b)) throw std::runtime_error("Invalid node in edge!");
+        bool marked = removed_edges.insert(edge_key(a, b));
+        bool found = false;
+        update(a, [b, &found] (adjacency_t& adj) {
+            found = adj.count(b);
+            adj.erase(b);
+        });
+        if (!directed) update(b, [a] (adjacency_t& adj) {adj.erase(a);});
+        if (!found && marked) removed_edges.erase(edge_key(a, b));
+        return found;
+    }
+
+    /**
+     * Moves the edge between a and b so that it connects a and c.
+     * Returns false if there was no edge between a and b.
+     */
+    bool rewire(node_id_t a, node_id_t b, node_id_t c) {
+        if (!remove_edge(a, b)) return false;
+        add_edge(a, c);
+        return true;
+    }
+
+    /**
+     * Adds a batch of edges.
+     */
+    void add_edges(const std::vector<edge_t>& edges) {
+        update_edges(edges, true);
+    }
+
+    /**
+     * Adds a batch of edges, edge i with link parameters params[i]. Link
+     * parameters can only be set while the manager is not running.
+     */
+    void add_edges(const std::vector<edge_t>& edges, const std::vector<LinkParams>& params) {
+        if (this->is_running()) throw std::runtime_error("Cannot change links while running");
+        if (edges.size() != params.size()) throw std::runtime_error("Every edge needs its link parameters");
+        update_edges(edges, true);
+        std::vector<std::tuple<node_id_t, node_id_t, LinkParams>> batch;
+        batch.reserve(edges.size());
+        for (std::size_t i=0; i<edges.size(); i++) batch.emplace_back(edges[i].first, edges[i].second, params[i]);
+        links.set_many(std::move(batch));
+    }
+
+    /**
+     * Adds all the edges of a graph in CSR form, such as csr_graph or
+     * mapped_graph, reading the neighbours of each node straight from it
+     * rather than from a list of edges. Undirected graphs must have each
+     * edge stored in both directions, as those do. Adjacency sets are
+     * filled in the node order, if one was set. If the workers are pinned
+     * and the manager is not running, they are filled by threads placed as
+     * the workers, as in add_nodes.
+     */
+    template<typename Graph>
+    void add_graph(const Graph& graph) {
+        if (graph.nodes() > graph_size()) throw std::runtime_error("Invalid node in edge!");
+        if (!order.empty() && graph.nodes() != order.size())
+            throw std::runtime_error("The graph does not match the node order");
+        auto add = [&] (int worker) {
+            std::vector<node_id_t> targets;
+            for (node_id_t index=0; index<graph.nodes(); index++) {
+                node_id_t n = slot_node(index);
+                if (worker >= 0 && builder(n) != worker) continue;
+                if (graph.degree(n) == 0) continue;
+                targets.assign(graph.neighbours_begin(n), graph.neighbours_end(n));
+                update(n, [&targets] (adjacency_t& adj) {adj.insert_many(targets);});
+            }
+        };
+        if (this->workers_pinned() && !this->is_running()) this->on_workers(add);
+        else add(-1);
+        // Edges that were removed are unmarked once they are all back, by
+        // this thread only.
+        if (removed_edges.empty()) return;
+        for (node_id_t n=0; n<graph.nodes(); n++)
+            for (auto t=graph.neighbours_begin(n); t!=graph.neighbours_end(n); t++)
+                removed_edges.erase(edge_key(n, *t));
+    }
+
+    /**
+     * Lays the nodes out in the given order, as returned by node_order: the
+     * i-th node added (by add_node or add_nodes) is node order[i], and
+     * nodes and their adjacency sets are allocated and filled in that
+     * order, so that neighbours are close to each other in memory. Node ids
+     * do not change: protocols, edges, partitions and the callbacks of
+     * add_nodes all use the ids of the graph. Must be called before any
+     * node is added.
+     */
+    void set_node_order(std::vector<node_id_t> new_order) {
+        if (graph_size() != 0) throw std::runtime_error("Cannot reorder nodes after adding them");
+        std::vector<node_id_t> new_position(new_order.size(), new_order.size());
+        for (std::size_t i=0; i<new_order.size(); i++) {
+            if (new_order[i] >= new_order.size() || new_position[new_order[i]] != new_order.size())
+                throw std::runtime_error("The node order is not a permutation");
+            new_position[new_order[i]] = i;
+        }
+        order = std::move(new_order);
+        position = std::move(new_position);
+    }
+
+    /**
+     * Removes a batch of edges.
+     */
+    void remove_edges(const std::vector<edge_t>& edges) {
+        update_edges(edges, false);
+    }
+
+    /**
+     * Splits the network in two, removing all the edges between nodes for
+     * which side returns different values. Returns the removed edges, each
+     * of them once, so that they can be given back to heal.
+     */
+    std::vector<edge_t> partition(const std::function<bool(node_id_t)>& side) {
+        std::vector<edge_t> cut;
+        {
+            epoch_guard g(this->epochs);
+            std::size_t n = graph_size();
+            for (node_id_t index=0; index<n; index++) {
+                node_id_t a = slot_node(index);
+                bool sa = side(a);
+                for (node_id_t b: adjacency(a)) {
+                    if ((directed || a < b) && side(b) != sa) cut.emplace_back(a, b);
+                }
+            }
+        }
+        remove_edges(cut);
+        return cut;
+    }
+
+    /**
+     * Adds back edges removed by partition.
+     */
+    void heal(const std::vector<edge_t>& edges) {
+        add_edges(edges);
+    }
+
+    /**
+     * Returns the number of messages lost because their edge was removed
+     * while they were being sent.
+     */
+    std::uint64_t severed_messages() const {
+        return severed;
+    }
+
+    /**
+     * Sets the parameters of the links that were not given their own.
+     */
+    void set_default_link(const LinkParams& params) {
+        if (this->is_running()) throw std::runtime_error("Cannot change links while running");
+        links.set_default(params);
+    }
+
+    ~GraphHardwareManager() {
+        std::size_t n = graph_size();
+        for (node_id_t i=0; i<n; i++) delete slot_at(i).load();
+        for (auto& segment: segments) delete[] segment.load();
     }
 };
 
@@ -0,0 +1,552 @@
+#ifndef DISTSIM_GRAPH_STATS_HPP
+#define DISTSIM_GRAPH_STATS_HPP
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "parallel.hpp"
+#include "rng.hpp"
+
+namespace graph_stats_detail {
+    static constexpr std::uint64_t nodes_per_task = 1<<14;
+
+    inline int thread_count(int nthreads) {
+        return nthreads == -1 ? std::thread::hardware_concurrency() : std::max(nthreads, 1);
+    }
+
+    /**
+     * Calls f(first, last, out) on ranges of [0, n) as parallel_for_ranges,
+     * and returns the concatenation of the vectors out in the order of the
+     * ranges.
+     */
+    template<typename T, typename F>
+    std::vector<T> parallel_gather(std::uint64_t n, std::uint64_t block, int nthreads, F&& f) {
+        std::vector<std::vector<T>> parts((n + block - 1) / block);
+        parallel_for_ranges(n, block, nthreads, [&] (std::uint64_t first, std::uint64_t last) {
+            f(first, last, parts[first / block]);
+        });
+        std::size_t size = 0;
+        for (const auto& p: parts) size += p.size();
+        std::vector<T> ans;
+        ans.reserve(size);
+        for (const auto& p: parts) ans.insert(ans.end(), p.begin(), p.end());
+        return ans;
+    }
+
+    /**
+     * Breadth-first search from up to 64 sources at once. Each node keeps a
+     * 64-bit mask of the sources that reached it, so a level is a single
+     * pass that ORs masks along arcs: it pushes masks from the nodes reached
+     * in the previous level while those are few, and pulls them into the
+     * nodes not yet reached by every source otherwise. The arrays are kept
+     * between searches.
+     */
+    template<typename Graph>
+    class multi_source_bfs {
+        typedef typename Graph::id_type Id;
+        const Graph& graph;
+        std::vector<std::uint64_t> frontier, visited;
+        std::unique_ptr<std::atomic<std::uint64_t>[]> next;
+    public:
+        multi_source_bfs(const Graph& graph):
+            graph(graph), frontier(graph.nodes()), visited(graph.nodes()),
+            next(new std::atomic<std::uint64_t>[graph.nodes()]()) {}
+
+        /**
+         * Runs a search from the given sources, calling reach(n, mask, level)
+         * for each node n and level at which it is reached by the sources
+         * in mask (bit i for sources[i]). Calls are concurrent, but never for
+         * the same node at the same time. Returns the eccentricity of each
+         * source in its component.
+         */
+        template<typename F>
+        std::vector<std::uint32_t> run(const std::vector<Id>& sources, int nthreads, F&& reach) {
+            std::uint64_t nodes = graph.nodes(), arcs = graph.arcs();
+            std::size_t count = sources.size();
+            std::uint64_t all_sources = count == 64 ? ~0ULL : (1ULL << count) - 1;
+            parallel_for_ranges(nodes, nodes_per_task, nthreads, [&] (std::uint64_t first, std::uint64_t last) {
+                std::fill(frontier.begin() + first, frontier.begin() + last, 0);
+                std::fill(visited.begin() + first, visited.begin() + last, 0);
+            });
+            std::vector<Id> active;
+            std::uint64_t scout = 0;
+            for (std::size_t i=0; i<count; i++) {
+                if (!frontier[sources[i]]) {
+                    active.push_back(sources[i]);
+                    scout += graph.degree(sources[i]);
+                }
+                frontier[sources[i]] |= 1ULL << i;
+                visited[sources[i]] |= 1ULL << i;
+            }
+            std::vector<std::uint32_t> ecc(count);
+            for (std::uint32_t level=1; !active.empty(); level++) {
+                std::vector<Id> reached;
+                if (scout < arcs / 14) {
+                    reached = parallel_gather<Id>(active.size(), 1<<10, nthreads,
+                        [&] (std::uint64_t first, std::uint64_t last, std::vector<Id>& out) {
+                            for (std::uint64_t i=first; i<last; i++) {
+                                std::uint64_t f = frontier[active[i]];
+                                for (auto t=graph.neighbours_begin(active[i]); t!=graph.neighbours_end(active[i]); t++) {
+                                    std::uint64_t m = f & ~visited[*t];
+                                    if (m && next[*t].fetch_or(m, std::memory_order_relaxed) == 0) out.push_back(*t);
+                                }
+                            }
+                        });
+                } else {
+                    reached = parallel_gather<Id>(nodes, nodes_per_task, nthreads,
+                        [&] (std::uint64_t first, std::uint64_t last, std::vector<Id>& out) {
+                            for (std::uint64_t n=first; n<last; n++) {
+                                std::uint64_t missing = all_sources & ~visited[n], m = 0;
+                                if (!missing) continue;
+                                for (auto t=graph.neighbours_begin(n); t!=graph.neighbours_end(n); t++) {
+                                    m |= frontier[*t];
+                                    if ((m & missing) == missing) break;
+                                }
+                                if (m & missing) {
+                                    next[n].store(m & missing, std::memory_order_relaxed);
+                                    out.push_back(n);
+                                }
+                            }
+                        });
+                }
+                for (auto n: active) frontier[n] = 0;
+                std::atomic<std::uint64_t> level_mask{0}, level_scout{0};
+                parallel_for_ranges(reached.size(), 1<<10, nthreads, [&] (std::uint64_t first, std::uint64_t last) {
+                    std::uint64_t mask = 0, s = 0;
+                    for (std::uint64_t i=first; i<last; i++) {
+                        Id n = reached[i];
+                        std::uint64_t m = next[n].exchange(0, std::memory_order_relaxed);
+                        visited[n] |= m;
+                        frontier[n] = m;
+                        reach(n, m, level);
+                        mask |= m;
+                        s += graph.degree(n);
+                    }
+                    level_mask.fetch_or(mask, std::memory_order_relaxed);
+                    level_scout.fetch_add(s, std::memory_order_relaxed);
+                });
+                for (std::size_t i=0; i<count; i++) if (level_mask >> i & 1) ecc[i] = level;
+                active = std::move(reached);
+                scout = level_scout;
+            }
+            return ecc;
+        }
+    };
+}
+
+/**
+ * Returns the number of nodes of each degree: ans[d] is the number of nodes
+ * with d neighbours.
+ *
+ * This and the following functions take an undirected graph in CSR form
+ * (csr_graph or mapped_graph) and run on nthreads threads (-1 means one per
+ * core).
+ */
+template<typename Graph>
+std::vector<std::uint64_t> degree_histogram(const Graph& graph, int nthreads=-1) {
+    using namespace graph_stats_detail;
+    std::atomic<std::uint64_t> max_degree{0};
+    parallel_for_ranges(graph.nodes(), nodes_per_task, nthreads, [&] (std::uint64_t first, std::uint64_t last) {
+        std::uint64_t m = 0;
+        for (std::uint64_t n=first; n<last; n++) m = std::max(m, graph.degree(n));
+        std::uint64_t cur = max_degree.load();
+        while (m > cur && !max_degree.compare_exchange_weak(cur, m));
+    });
+    std::vector<std::uint64_t> ans(graph.nodes() ? max_degree+1 : 0);
+    std::mutex ans_mutex;
+    // Most nodes have small degrees, which are counted locally.
+    static constexpr std::uint64_t local_degrees = 256;
+    parallel_for_ranges(graph.nodes(), nodes_per_task, nthreads, [&] (std::uint64_t first, std::uint64_t last) {
+        std::uint64_t local[local_degrees] = {};
+        std::vector<std::uint64_t> large;
+        for (std::uint64_t n=first; n<last; n++) {
+            std::uint64_t d = graph.degree(n);
+            if (d < local_degrees) local[d]++;
+            else large.push_back(d);
+        }
+        std::lock_guard<std::mutex> lck(ans_mutex);
+        for (std::uint64_t d=0; d<local_degrees && d<ans.size(); d++) ans[d] += local[d];
+        for (auto d: large) ans[d]++;
+    });
+    return ans;
+}
+
+/**
+ * Returns the connected component of each node, identified by its smallest
+ * node.
+ *
+ * Components are found with a concurrent union-find: roots are only linked
+ * below smaller roots, with a compare-and-swap, so the forest never has
+ * cycles, and paths are halved while they are followed.
+ */
+template<typename Graph>
+std::vector<typename Graph::id_type> connected_components(const Graph& graph, int nthreads=-1) {
+    using namespace graph_stats_detail;
+    typedef typename Graph::id_type Id;
+    std::uint64_t nodes = graph.nodes();
+    std::unique_ptr<std::atomic<Id>[]> parent(new std::atomic<Id>[nodes]);
+    parallel_for_ranges(nodes, nodes_per_task, nthreads, [&] (std::uint64_t first, std::uint64_t last) {
+        for (std::uint64_t n=first; n<last; n++) parent[n].store(n, std::memory_order_relaxed);
+    });
+    auto find = [&] (Id x) {
+        while (true) {
+            Id p = parent[x].load(std::memory_order_relaxed);
+            if (p == x) return x;
+            Id gp = parent[p].load(std::memory_order_relaxed);
+            if (gp != p) parent[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+            x = gp;
+        }
+    };
+    parallel_for_ranges(nodes, nodes_per_task, nthreads, [&] (std::uint64_t first, std::uint64_t last) {
+        for (std::uint64_t n=first; n<last; n++) {
+            for (auto t=graph.neighbours_begin(n); t!=graph.neighbours_end(n); t++) {
+                if (*t >= n) break;
+                Id a = n, b = *t;
+                while (true) {
+                    a = find(a);
+                    b = find(b);
+                    if (a == b) break;
+                    if (a < b) std::swap(a, b);
+                    Id expected = a;
+                    if (parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed)) break;
+                }
+            }
+        }
+    });
+    std::vector<Id> ans(nodes);
+    parallel_for_ranges(nodes, nodes_per_task, nthreads, [&] (std::uint64_t first, std::uint64_t last) {
+        for (std::uint64_t n=first; n<last; n++) ans[n] = find(n);
+    });
+    return ans;
+}
+
+/**
+ * Bounds on the eccentricities of the nodes of a connected component and on
+ * its diameter. lower[n] is a lower bound for the eccentricity of node n, and
+ * is 0 for nodes outside the component.
+ */
+struct eccentricity_bounds {
+    std::vector<std::uint32_t> lower;
+    std::uint64_t diameter_lower = 0;
+    std::uint64_t diameter_upper = 0;
+    std::uint64_t sources = 0;
+};
+
+/**
+ * Estimates the eccentricities in the component of the given node (as
+ * returned by connected_components) with rounds of breadth-first searches
+ * from 64 sources at once.
+ *
+ * The first round starts from random nodes; later rounds start from the
+ * nodes with the highest lower bounds so far, which are usually at the ends
+ * of the longest paths. The eccentricity of each source is exact, and
+ * bounds the diameter from below, and twice it bounds it from above.
+ */
+template<typename Graph, typename Id>
+eccentricity_bounds estimate_eccentricities(const Graph& graph, const std::vector<Id>& component, Id comp,
+                                            int rounds=4, std::uint64_t seed=0, int nthreads=-1) {
+    using namespace graph_stats_detail;
+    std::uint64_t nodes = graph.nodes();
+    eccentricity_bounds ans;
+    ans.lower.assign(nodes, 0);
+    std::vector<Id> members = parallel_gather<Id>(nodes, nodes_per_task, nthreads,
+        [&] (std::uint64_t first, std::uint64_t last, std::vector<Id>& out) {
+            for (std::uint64_t n=first; n<last; n++) if (component[n] == comp) out.push_back(n);
+        });
+    if (members.empty()) return ans;
+    ans.diameter_upper = ~0ULL;
+    std::vector<bool> used(nodes);
+    multi_source_bfs<Graph> bfs(graph);
+    xoroshiro r = seeded_rng(seed, 0);
+
+    for (int round=0; round<rounds; round++) {
+        std::vector<Id> candidates;
+        for (auto n: members) if (!used[n]) candidates.push_back(n);
+        if (candidates.empty()) break;
+        std::size_t count = std::min<std::size_t>(64, candidates.size());
+        if (round == 0) {
+            for (std::size_t i=0; i<count; i++) std::swap(candidates[i], candidates[i + r(candidates.size() - i)]);
+        } else {
+            std::nth_element(candidates.begin(), candidates.begin() + count - 1, candidates.end(), [&] (Id a, Id b) {
+                return ans.lower[a] > ans.lower[b];
+            });
+        }
+        std::vector<Id> sources(candidates.begin(), candidates.begin() + count);
+        for (auto n: sources) used[n] = true;
+        ans.sources += count;
+        std::vector<std::uint32_t> ecc = bfs.run(sources, nthreads, [&] (Id n, std::uint64_t, std::uint32_t level) {
+            ans.lower[n] = std::max(ans.lower[n], level);
+        });
+        for (std::size_t i=0; i<count; i++) {
+            ans.lower[sources[i]] = std::max(ans.lower[sources[i]], ecc[i]);
+            ans.diameter_lower = std::max<std::uint64_t>(ans.diameter_lower, ecc[i]);
+            ans.diameter_upper = std::min<std::uint64_t>(ans.diameter_upper, 2*ecc[i]);
+        }
+    }
+    return ans;
+}
+
+/**
+ * Number of triangles through each node, and the resulting clustering
+ * coefficients.
+ */
+struct clustering_stats {
+    std::vector<std::uint64_t> triangles;
+    std::uint64_t total_triangles = 0;
+    // Mean of the local coefficients, with nodes of degree 0 or 1 counting
+    // as 0.
+    double average = 0;
+    // Three times the triangles divided by the paths of length 2.
+    double transitivity = 0;
+};
+
+/**
+ * Counts the triangles of the graph. Arcs are oriented from each node to
+ * the neighbours that come after it in the order of degree (then id), so
+ * that every triangle is found once, from its first node, by intersecting
+ * the sorted lists of out-neighbours; high degree nodes have few of them.
+ */
+template<typename Graph>
+clustering_stats clustering(const Graph& graph, int nthreads=-1) {
+    using namespace graph_stats_detail;
+    typedef typename Graph::id_type Id;
+    std::uint64_t nodes = graph.nodes();
+    auto before = [&] (std::uint64_t a, std::uint64_t b) {
+        std::uint64_t da = graph.degree(a), db = graph.degree(b);
+        return da < db || (da == db && a < b);
+    };
+    std::vector<std::uint64_t> offsets(nodes+1);
+    parallel_for_ranges(nodes, nodes_per_task, nthreads, [&] (std::uint64_t first, std::uint64_t last) {
+        for (std::uint64_t n=first; n<last; n++)
+            for (auto t=graph.neighbours_begin(n); t!=graph.neighbours_end(n); t++)
+                offsets[n+1] += before(n, *t);
+    });
+    for (std::uint64_t n=0; n<nodes; n++) offsets[n+1] += offsets[n];
+    std::vector<Id> out(offsets[nodes]);
+    parallel_for_ranges(nodes, nodes_per_task, nthreads, [&] (std::uint64_t first, std::uint64_t last) {
+        for (std::uint64_t n=first; n<last; n++) {
+            std::uint64_t p = offsets[n];
+            for (auto t=graph.neighbours_begin(n); t!=graph.neighbours_end(n); t++)
+                if (before(n, *t)) out[p++] = *t;
+        }
+    });
+
+    std::unique_ptr<std::atomic<std::uint64_t>[]> triangles(new std::atomic<std::uint64_t>[nodes]());
+    parallel_for_ranges(nodes, 1<<10, nthreads, [&] (std::uint64_t first, std::uint64_t last) {
+        for (std::uint64_t a=first; a<last; a++) {
+            std::uint64_t found = 0;
+            for (std::uint64_t i=offsets[a]; i<offsets[a+1]; i++) {
+                Id b = out[i];
+                std::uint64_t found_b = 0;
+                auto x = out.begin() + offsets[a], x_end = out.begin() + offsets[a+1];
+                auto y = out.begin() + offsets[b], y_end = out.begin() + offsets[b+1];
+                while (x != x_end && y != y_end) {
+                    if (*x < *y) x++;
+                    else if (*y < *x) y++;
+                    else {
+                        triangles[*x].fetch_add(1, std::memory_order_relaxed);
+                        found_b++;
+                        x++;
+                        y++;
+                    }
+                }
+                if (found_b) triangles[b].fetch_add(found_b, std::memory_order_relaxed);
+                found += found_b;
+            }
+            if (found) triangles[a].fetch_add(found, std::memory_order_relaxed);
+        }
+    });
+
+    clustering_stats ans;
+    ans.triangles.resize(nodes);
+    double sum = 0, wedges = 0;
+    for (std::uint64_t n=0; n<nodes; n++) {
+        std::uint64_t t = triangles[n].load(std::memory_order_relaxed), d = graph.degree(n);
+        ans.triangles[n] = t;
+        ans.total_triangles += t;
+        double w = d * (d - 1) / 2.0;
+        if (d > 1) sum += t / w;
+        wedges += w;
+    }
+    ans.total_triangles /= 3;
+    if (nodes) ans.average = sum / nodes;
+    if (wedges) ans.transitivity = 3 * ans.total_triangles / wedges;
+    return ans;
+}
+
+/**
+ * Estimates the closeness centrality of every node from its distances to
+ * samples random sources, searched from 64 at a time: the number of sources
+ * it reaches, divided by the sum of their distances, so that nodes close to
+ * most of the graph have the highest values. Nodes in small components are
+ * penalized by scaling by the fraction of sources they reach.
+ */
+template<typename Graph>
+std::vector<double> approximate_closeness(const Graph& graph, std::uint64_t samples, std::uint64_t seed=0, int nthreads=-1) {
+    using namespace graph_stats_detail;
+    typedef typename Graph::id_type Id;
+    std::uint64_t nodes = graph.nodes();
+    samples = std::min(samples, nodes);
+    xoroshiro r = seeded_rng(seed, 0);
+    std::vector<std::uint64_t> sources = r.get_distinct(samples, nodes);
+    std::vector<std::uint64_t> distance(nodes);
+    std::vector<std::uint32_t> reached(nodes);
+    multi_source_bfs<Graph> bfs(graph);
+    for (std::uint64_t first=0; first<samples; first+=64) {
+        std::vector<Id> batch(sources.begin() + first, sources.begin() + std::min(samples, first+64));
+        bfs.run(batch, nthreads, [&] (Id n, std::uint64_t mask, std::uint32_t level) {
+            std::uint64_t count = __builtin_popcountll(mask);
+            distance[n] += count * level;
+            reached[n] += count;
+        });
+    }
+    std::vector<double> ans(nodes);
+    parallel_for_ranges(nodes, nodes_per_task, nthreads, [&] (std::uint64_t first, std::uint64_t last) {
+        for (std::uint64_t n=first; n<last; n++)
+            if (distance[n]) ans[n] = (double)reached[n] / distance[n] * reached[n] / samples;
+    });
+    return ans;
+}
+
+/**
+ * Returns the core number of every node: the largest k such that the node
+ * belongs to a subgraph where all nodes have degree at least k.
+ *
+ * Nodes are peeled in parallel: for each k, the nodes left with degree at
+ * most k are removed together, and the neighbours whose degree drops to k
+ * because of that are removed next, until none is left; then k grows to the
+ * smallest degree left.
+ */
+template<typename Graph>
+std::vector<std::uint32_t> core_numbers(const Graph& graph, int nthreads=-1) {
+    using namespace graph_stats_detail;
+    typedef typename Graph::id_type Id;
+    std::uint64_t nodes = graph.nodes();
+    std::unique_ptr<std::atomic<std::uint32_t>[]> degree(new std::atomic<std::uint32_t>[nodes]);
+    std::unique_ptr<std::atomic<bool>[]> removed(new std::atomic<bool>[nodes]);
+    std::vector<std::uint32_t> ans(nodes);
+    std::vector<Id> left(nodes);
+    parallel_for_ranges(nodes, nodes_per_task, nthreads, [&] (std::uint64_t first, std::uint64_t last) {
+        for (std::uint64_t n=first; n<last; n++) {
+            degree[n].store(graph.degree(n), std::memory_order_relaxed);
+            removed[n].store(false, std::memory_order_relaxed);
+            left[n] = n;
+        }
+    });
+    std::uint32_t k = 0;
+    while (!left.empty()) {
+        std::vector<Id> peel = parallel_gather<Id>(left.size(), nodes_per_task, nthreads,
+            [&] (std::uint64_t first, std::uint64_t last, std::vector<Id>& out) {
+                for (std::uint64_t i=first; i<last; i++)
+                    if (degree[left[i]].load(std::memory_order_relaxed) <= k) out.push_back(left[i]);
+            });
+        while (!peel.empty()) {
+            for (auto n: peel) removed[n].store(true, std::memory_order_relaxed);
+            peel = parallel_gather<Id>(peel.size(), 1<<10, nthreads,
+                [&] (std::uint64_t first, std::uint64_t last, std::vector<Id>& out) {
+                    for (std::uint64_t i=first; i<last; i++) {
+                        ans[peel[i]] = k;
+                        for (auto t=graph.neighbours_begin(peel[i]); t!=graph.neighbours_end(peel[i]); t++) {
+                            if (removed[*t].load(std::memory_order_relaxed)) continue;
+                            if (degree[*t].fetch_sub(1, std::memory_order_relaxed) == k+1) out.push_back(*t);
+                        }
+                    }
+                });
+        }
+        std::atomic<std::uint32_t> min_degree{~0U};
+        left = parallel_gather<Id>(left.size(), nodes_per_task, nthreads,
+            [&] (std::uint64_t first, std::uint64_t last, std::vector<Id>& out) {
+                std::uint32_t m = ~0U;
+                for (std::uint64_t i=first; i<last; i++) {
+                    if (removed[left[i]].load(std::memory_order_relaxed)) continue;
+                    out.push_back(left[i]);
+                    m = std::min(m, degree[left[i]].load(std::memory_order_relaxed));
+                }
+                std::uint32_t cur = min_degree.load();
+                while (m < cur && !min_degree.compare_exchange_weak(cur, m));
+            });
+        k = std::max(k+1, min_degree.load());
+    }
+    return ans;
+}
+
+/**
+ * Estimates the betweenness centrality of every node (the number of
+ * shortest paths between pairs of other nodes that go through it, split
+ * between the shortest paths of each pair) from the shortest paths of
+ * samples random sources, with the algorithm of Brandes, scaled to all
+ * sources. Each thread runs its own searches and sums into its own vector.
+ */
+template<typename Graph>
+std::vector<double> approximate_betweenness(const Graph& graph, std::uint64_t samples, std::uint64_t seed=0, int nthreads=-1) {
+    using namespace graph_stats_detail;
+    typedef typename Graph::id_type Id;
+    std::uint64_t nodes = graph.nodes();
+    if (nodes == 0) return {};
+    samples = std::min(samples, nodes);
+    xoroshiro r = seeded_rng(seed, 0);
+    std::vector<std::uint64_t> sources = r.get_distinct(samples, nodes);
+    int threads = std::max<int>(1, std::min<std::uint64_t>(thread_count(nthreads), samples));
+    std::vector<std::vector<double>> partial(threads);
+    std::atomic<std::uint64_t> next_source{0};
+    parallel_for(threads, threads, [&] (std::uint64_t t) {
+        std::vector<double>& centrality = partial[t];
+        centrality.assign(nodes, 0);
+        // The state of a node is kept together, as it is read through random
+        // arcs; coefficient is (1 + dependency) / paths once the dependency
+        // of the node is known.
+        struct node_state {
+            double paths = 0;
+            double coefficient = 0;
+            std::uint32_t dist = ~0U;
+        };
+        std::vector<node_state> state(nodes);
+        std::vector<Id> order;
+        order.reserve(nodes);
+        for (std::uint64_t i = next_source++; i < samples; i = next_source++) {
+            Id s = sources[i];
+            order.assign(1, s);
+            state[s].dist = 0;
+            state[s].paths = 1;
+            for (std::size_t q=0; q<order.size(); q++) {
+                Id v = order[q];
+                std::uint32_t d = state[v].dist + 1;
+                double paths = state[v].paths;
+                for (auto u=graph.neighbours_begin(v); u!=graph.neighbours_end(v); u++) {
+                    node_state& su = state[*u];
+                    if (su.dist == ~0U) {
+                        su.dist = d;
+                        order.push_back(*u);
+                    }
+                    if (su.dist == d) su.paths += paths;
+                }
+            }
+            for (std::size_t q=order.size(); q-- > 0;) {
+                Id v = order[q];
+                std::uint32_t d = state[v].dist + 1;
+                double sum = 0;
+                for (auto u=graph.neighbours_begin(v); u!=graph.neighbours_end(v); u++)
+                    if (state[*u].dist == d) sum += state[*u].coefficient;
+                double dependency = state[v].paths * sum;
+                state[v].coefficient = (1 + dependency) / state[v].paths;
+                if (v != s) centrality[v] += dependency;
+            }
+            for (auto v: order) state[v] = node_state();
+        }
+    });
+    // Each pair is found from both its ends when all sources are used.
+    double scale = (double)nodes / samples / 2;
+    std::vector<double> ans(nodes);
+    parallel_for_ranges(nodes, nodes_per_task, nthreads, [&] (std::uint64_t first, std::uint64_t last) {
+        for (std::uint64_t n=first; n<last; n++) {
+            double sum = 0;
+            for (const auto& p: partial) sum += p[n];
+            ans[n] = sum * scale;
+        }
+    });
+    return ans;
+}
+#endif
@@ -10,26 +10,233 @@
 #include <atomic>
 #include <iostream>
 #include "concurrentqueue.hpp"
+#include "futex.hpp"
 #include "common.hpp"
 #include "node.hpp"
 #include "message.hpp"
+#include "mailbox.hpp"
+#include "generator.hpp"
+#include "timer_wheel.hpp"
+#include "epoch.hpp"
+#include "node_index.hpp"
+#include "numa.hpp"
 #include "rng.hpp"
 
 template <typename T>
 class HardwareManager {
+    friend class Node<T>;
+    friend class EventGenerator<T>;
 private:
     const node_id_t max_id;
     const int nthreads;
+protected:
     const uint64_t fail_thres;
-    std::map<node_id_t, std::unique_ptr<Node<T>>> nodes;
+    // Nodes can be added and removed while workers run: every access to
+    // them must be inside a critical section of epochs.
+    mutable EpochManager epochs;
+    typedef EpochManager::guard epoch_guard;
+private:
+    NodeIndex<Node<T>> nodes;
 
     moodycamel::ConcurrentQueue<node_id_t> nodes_queue;
+    // Nodes that were assigned to a worker are queued on its own queue
+    // rather than on nodes_queue, so that they are mostly handled by the
+    // same thread; workers with nothing to do take nodes from nodes_queue
+    // and then from the queues of the others.
+    std::vector<std::uint32_t> home;
+    std::vector<std::unique_ptr<moodycamel::ConcurrentQueue<node_id_t>>> worker_queues;
+    struct alignas(64) worker_counters {
+        std::atomic<std::uint64_t> local{0};
+        std::atomic<std::uint64_t> remote{0};
+        std::atomic<std::uint64_t> stolen{0};
+        std::atomic<std::uint64_t> cross_numa_sends{0};
+        std::atomic<std::uint64_t> cross_numa_stolen{0};
+    };
+    std::unique_ptr<worker_counters[]> counters;
+    // Placement of the workers, if they are pinned to CPUs.
+    worker_placement placement;
+    // Index of the worker running on this thread, -1 outside the workers.
+    static inline thread_local int current_worker = -1;
+    std::atomic<bool> running;
     std::atomic<bool> stopping;
     std::atomic<bool> pausing;
     std::atomic<int> running_threads;
     std::vector<std::thread> workers;
     std::uint64_t seed;
 
+    MailboxConfig mailbox;
+    std::atomic<std::uint64_t> dropped;
+    std::atomic<std::uint64_t> blocked;
+    std::atomic<std::uint64_t> undelivered;
+
+    // Messages that were enqueued or are being generated and have not been
+    // fully handled yet. The system is quiescent when this reaches 0.
+    std::atomic<long long> pending_work;
+    // Futex word, bumped every time waiters should re-check their condition.
+    std::atomic<std::uint32_t> progress;
+    std::atomic<int> waiters;
+
+    std::vector<std::unique_ptr<EventGenerator<T>>> generators;
+    std::chrono::steady_clock::time_point clock_start;
+
+    // Timers are kept with a resolution of 2^timer_tick_shift nanoseconds.
+    static const int timer_tick_shift = 10;
+    TimerWheel timers;
+    moodycamel::ConcurrentQueue<timer_entry> expired_timers;
+
+    /**
+     * Returns the nanoseconds elapsed since the creation of the manager, or
+     * since the start given to set_clock_start.
+     */
+    long long clock() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - clock_start
+        ).count();
+    }
+
+    /**
+     * Fires the generators that are due. Every firing is claimed by moving
+     * the generator's next firing time forward, so that workers can fire
+     * the same generator concurrently. At most max_burst events per
+     * generator are fired in a single call, so that a generator that is
+     * late does not starve message handling.
+     */
+    void fire_generators() {
+        static const int max_burst = 64;
+        if (generators.empty()) return;
+        long long now = clock();
+        for (auto& gen: generators) {
+            long long due = gen->next_fire.load(std::memory_order_relaxed);
+            for (int burst = 0; burst < max_burst && due <= now && !gen->done(); ) {
+                long long next = due + gen->next_interval().count();
+                if (!gen->next_fire.compare_exchange_weak(due, next)) continue;
+                std::uint64_t n = gen->fired_++;
+                if (n >= gen->limit) break;
+                try {
+                    gen->fire(*this);
+                } catch (std::exception& e) {
+                    std::cerr << "Error during generator firing: " << e.what() << std::endl;
+                }
+                // Only released after the last event holds its own pending work.
+                if (n + 1 == gen->limit) gen->finish();
+                due = next;
+                burst++;
+            }
+        }
+    }
+
+    /**
+     * Schedules a call to the handle_timer method of the given node.
+     * A pending timer counts as pending work.
+     */
+    void schedule_timer(node_id_t node, std::chrono::nanoseconds delay, std::uint64_t token) {
+        add_work();
+        // Round up, so that timers never expire early.
+        std::uint64_t expiry = (clock() + delay.count() + (1LL << timer_tick_shift) - 1) >> timer_tick_shift;
+        timers.schedule(timer_entry{node, token, expiry});
+    }
+
+    /**
+     * Moves the expired timers to the queue of timers to be handled, if no
+     * other worker is doing it, and handles a batch of them.
+     */
+    void handle_timers() {
+        static const int batch_size = 128;
+        if (timers.pending()) {
+            timers.advance(clock() >> timer_tick_shift, [this] (const timer_entry& e) {
+                expired_timers.enqueue(e);
+            });
+        }
+        timer_entry batch[batch_size];
+        std::size_t count = expired_timers.try_dequeue_bulk(batch, batch_size);
+        for (std::size_t i=0; i<count; i++) {
+            try {
+                // The node might have failed in the meantime.
+                if (Node<T>* nd = nodes.find(batch[i].node))
+                    nd->handle_timer(batch[i].token);
+            } catch (std::exception& e) {
+                std::cerr << "Error during handle_timer: " << e.what() << std::endl;
+            }
+            work_done();
+        }
+    }
+
+    /**
+     * Queues a node that has messages to handle.
+     */
+    void schedule(node_id_t node) {
+        if (node < home.size()) worker_queues[home[node]]->enqueue(node);
+        else nodes_queue.enqueue(node);
+    }
+
+    /**
+     * Returns true if the two workers are pinned to different NUMA nodes.
+     */
+    bool cross_numa(int a, int b) const {
+        return !placement.node.empty() && placement.node[a] != placement.node[b];
+    }
+
+    /**
+     * Takes the next node to handle for the given worker: from its own queue
+     * if it has one, then from the shared queue, then from the queues of the
+     * other workers that have a backlog, starting from the next one. Workers
+     * on the same NUMA node are tried before the others.
+     */
+    bool next_node(int worker, node_id_t& node) {
+        static const std::size_t steal_threshold = 4;
+        if (worker_queues.empty()) return nodes_queue.try_dequeue(node);
+        if (worker_queues[worker]->try_dequeue(node)) return true;
+        if (nodes_queue.try_dequeue(node)) return true;
+        for (bool remote: {false, true}) {
+            for (int i=1; i<nthreads; i++) {
+                int victim = (worker + i) % nthreads;
+                if (cross_numa(worker, victim) != remote) continue;
+                auto& queue = *worker_queues[victim];
+                if (queue.size_approx() >= steal_threshold && queue.try_dequeue(node)) {
+                    counters[worker].stolen.fetch_add(1, std::memory_order_relaxed);
+                    if (remote) counters[worker].cross_numa_stolen.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Fires the due generators and timers, and handles the messages of one
+     * node. Returns false if there was no node to handle.
+     */
+    bool step(int worker) {
+        epoch_guard g(epochs);
+        fire_generators();
+        handle_timers();
+        node_id_t node_idx;
+        if (!next_node(worker, node_idx)) return false;
+        // The node might have failed in the meantime.
+        Node<T>* node = nodes.find(node_idx);
+        if (node == nullptr) return true;
+        try {
+            int num = 0;
+            while (true) {
+                if (num++ > 128) {
+                    schedule(node->id());
+                    break;
+                }
+                int ret = node->handle_one_message();
+                if (ret == 0) break;
+                if (ret == 1) continue;
+                if (ret == -1) {
+                    schedule(node->id());
+                    break;
+                }
+                throw std::runtime_error("Invalid return value from handle_one_message");
+            }
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+        return true;
+    }
+
     /**
      * Computes the actual number of threads in function of nt.
      */
@@ -40,6 +247,70 @@ private:
         return nthreads;
     }
 protected:
+    /**
+     * Accounts for new work that will eventually be completed by work_done.
+     */
+    void add_work(long long amount = 1) {
+        pending_work += amount;
+    }
+
+    /**
+     * Accounts for completed work, waking up waiters if the system became idle.
+     */
+    void work_done(long long amount = 1) {
+        if ((pending_work -= amount) == 0) notify();
+    }
+
+    /**
+     * Returns true if the node is handled by another manager, to which
+     * send_message hands messages with forward. Only called for nodes this
+     * manager does not have.
+     */
+    virtual bool is_remote(node_id_t node) const {
+        return false;
+    }
+
+    /**
+     * Hands a message to the manager that handles the receiver, once the
+     * link from the sender has been applied to it.
+     */
+    virtual void forward(node_id_t sender, node_id_t receiver, Message<T> msg) {
+        undelivered++;
+    }
+
+    /**
+     * Puts a message in the mailbox of a node, as the last step of
+     * send_message. Messages to nodes that do not exist are lost. If wait
+     * is false, a full backpressure mailbox drops the message instead of
+     * blocking the caller.
+     */
+    void deliver(node_id_t receiver, Message<T> msg, bool wait = true) {
+        epoch_guard g(epochs);
+        Node<T>* nd = nodes.find(receiver);
+        if (nd == nullptr) {
+            undelivered++;
+            return;
+        }
+        deliver(nd, receiver, std::move(msg), wait);
+    }
+
+    /**
+     * Sets the delay added to a message by the link it is sent on.
+     */
+    static void set_link_delay(Message<T>& msg, std::chrono::nanoseconds delay) {
+        msg.link_delay_ = delay;
+    }
+
+    /**
+     * Moves the origin of the clock of the manager, for example to share it
+     * with other managers. Timers scheduled before move with it. Can only be
+     * called while the manager is not running.
+     */
+    void set_clock_start(std::chrono::steady_clock::time_point start) {
+        if (running) throw std::runtime_error("Cannot move the clock while running");
+        clock_start = start;
+    }
+
     /**
      * Generate a random id
      */
@@ -47,16 +318,20 @@ protected:
         return rng() % max_id;
     }
 
+    /**
+     * Inserts a node. It is safe to call this while the workers are running.
+     * Throws duplicate_node_error if the id is taken.
+     */
     template<typename node_t>
     void add_node(std::unique_ptr<node_t> ptr) {
-        pause();
         auto id = ptr->id();
-        {
-            run_lock lck(this);
-            nodes.emplace(id, std::move(ptr));
-        }
+        ptr->set_mailbox(mailbox);
+        Node<T>* nd = ptr.get();
+        epoch_guard g(epochs);
+        if (!nodes.insert(id, nd, !running)) throw duplicate_node_error();
+        ptr.release();
         try {
-            nodes[id]->init();
+            nd->init();
         } catch (std::exception& e) {
             std::cerr << "Error during init!" << std::endl;
         }
@@ -70,7 +345,9 @@ public:
         double link_fail_chance = 0
     ): max_id(max_id), nthreads{compute_nthreads(nt)},
        fail_thres(link_fail_chance * std::numeric_limits<uint64_t>::max()),
-       stopping(false), pausing(false), running_threads(0), seed(seed) {}
+       nodes(epochs), counters(new worker_counters[nthreads]), running(false), stopping(false), pausing(false),
+       running_threads(0), seed(seed), mailbox(), dropped(0), blocked(0), undelivered(0),
+       pending_work(0), progress(0), waiters(0), clock_start(std::chrono::steady_clock::now()) {}
 
     class run_lock {
         HardwareManager* manager;
@@ -90,6 +367,18 @@ public:
         return a != b;
     }
 
+    /**
+     * Models the link from a to b for a message that is being sent on it:
+     * throws if a cannot send to b, returns false if the message is lost
+     * and otherwise sets the link delay of the message. This is the only
+     * virtual call made for every send.
+     */
+    virtual bool transmit(node_id_t a, node_id_t b, Message<T>& msg) {
+        if (!can_send(a, b))
+            throw std::runtime_error("The sender cannot send to the receiver!");
+        return !(rng() < fail_thres);
+    }
+
     /**
      * Iterate on n's neighbours, executing callback for every neighbour found.
      * If the callback returns true the iteration continues, otherwise
@@ -99,11 +388,11 @@ public:
         node_id_t n,
         const std::function<bool(node_id_t)>& callback
     ) const {
-        for (auto& node: nodes) {
-            if (can_send(n, node.second->id())) {
-                if (!callback(node.second->id())) break;
-            }
-        }
+        epoch_guard g(epochs);
+        nodes.for_each([&] (node_id_t id, Node<T>*) {
+            if (can_send(n, id)) return callback(id);
+            return true;
+        });
     };
 
     /**
@@ -122,7 +411,7 @@ public:
      * Return the number of n's neighbours.
      */
     virtual std::size_t count_neighbours(node_id_t n) const {
-        std::size_t ans;
+        std::size_t ans = 0;
         iter_neighbours(n, [&ans] (node_id_t neigh) {
             ans++;
             return true;
@@ -135,7 +424,9 @@ public:
      * the given one.
      */
     bool has_bigger_id(node_id_t i) const {
-        return nodes.end() != nodes.lower_bound(i);
+        node_id_t ans;
+        epoch_guard g(epochs);
+        return nodes.lower_bound(i, ans);
     }
 
     /**
@@ -143,59 +434,316 @@ public:
      * exception if there is none.
      */
     node_id_t next_id(node_id_t i) const {
-        if (!has_bigger_id(i)) throw std::runtime_error("Invalid argument");
-        return nodes.lower_bound(i)->first;
+        node_id_t ans;
+        epoch_guard g(epochs);
+        if (!nodes.lower_bound(i, ans)) throw std::runtime_error("Invalid argument");
+        return ans;
     }
 
     /**
      * Generates a message at a given node.
      */
     void gen_message(node_id_t sender, const T& data = T{}) {
-        Node<T>* nd;
-        if (!nodes.count(sender)) throw std::runtime_error("Invalid sender");
-        nd = nodes.at(sender).get();
+        epoch_guard g(epochs);
+        Node<T>* nd = nodes.find(sender);
+        if (nd == nullptr) throw std::runtime_error("Invalid sender");
+        add_work();
         try {
             nd->start_message(Message<T>{data});
         } catch (std::exception& e) {
             std::cerr << "Error during start_message!" << std::endl;
         }
+        work_done();
     }
 
     /**
-     * Gets read-only access to a given node.
+     * Gets read-only access to a given node. The pointer is invalidated if
+     * the node fails.
      */
     const Node<T>* get(node_id_t node) const {
-        if (!nodes.count(node)) throw std::runtime_error("Invalid node");
-        return nodes.at(node).get();
+        epoch_guard g(epochs);
+        const Node<T>* nd = nodes.find(node);
+        if (nd == nullptr) throw std::runtime_error("Invalid node");
+        return nd;
+    }
+
+    /**
+     * Returns true if the node exists, i.e. it was added and did not fail.
+     */
+    bool has_node(node_id_t node) const {
+        epoch_guard g(epochs);
+        return nodes.find(node) != nullptr;
     }
 
     /**
      * Forwards a message to a given node. Throws an exception if the sender
-     * or the receiver do not exist or if the sender cannot send messages to
-     * the receiver.
+     * cannot send messages to the receiver. If either of them does not exist,
+     * for example because it just failed, the message is lost.
      */
     void send_message(node_id_t sender, node_id_t receiver, Message<T> msg) {
-        if (rng() < fail_thres) return;
-        if (!nodes.count(sender))
-            throw std::runtime_error("Invalid sender");
-        if (!nodes.count(receiver))
-            throw std::runtime_error("Invalid receiver");
-        if (!can_send(sender, receiver))
-            throw std::runtime_error("The sender cannot send to the receiver!");
+        epoch_guard g(epochs);
+        Node<T>* nd = nodes.find(receiver);
+        if ((nd == nullptr && !is_remote(receiver)) || nodes.find(sender) == nullptr) {
+            undelivered++;
+            return;
+        }
+        msg.link_delay_ = std::chrono::nanoseconds(0);
+        if (!transmit(sender, receiver, msg)) return;
         msg.hops++;
-        Node<T>* nd;
-        nd = nodes.at(receiver).get();
-        nd->enqueue(std::move(msg));
-        nodes_queue.enqueue(receiver);
+        if (nd == nullptr) forward(sender, receiver, std::move(msg));
+        else deliver(nd, receiver, std::move(msg));
+    }
+private:
+    /**
+     * Returns true if the node can only be handled by the calling worker
+     * while it is busy: it is the only worker, or the node is assigned to it
+     * and others only steal from longer queues. Waiting for space in the
+     * mailbox of such a node would always time out.
+     */
+    bool drained_only_by_me(node_id_t receiver) const {
+        if (current_worker < 0) return false;
+        return nthreads == 1 || (receiver < home.size() && home[receiver] == (std::uint32_t)current_worker);
+    }
+
+    /**
+     * Puts a message in the mailbox of a node, applying its overflow policy,
+     * and queues the node. With backpressure, a worker does not wait for the
+     * nodes only it can drain (see drained_only_by_me), and no caller waits
+     * if wait is false: the message is dropped right away. Called inside a
+     * critical section of epochs.
+     */
+    void deliver(Node<T>* nd, node_id_t receiver, Message<T> msg, bool wait = true) {
+        if (wait && nd->mailbox_.policy == MailboxPolicy::backpressure && nd->full() && !drained_only_by_me(receiver)) {
+            // Note that if all the workers end up waiting on each other, no
+            // progress is made until the timeouts expire.
+            blocked++;
+            auto deadline = std::chrono::steady_clock::now() + nd->mailbox_.backpressure_timeout;
+            while (nd->full() && std::chrono::steady_clock::now() < deadline)
+                std::this_thread::yield();
+        }
+        if (!nd->enqueue(std::move(msg))) {
+            dropped++;
+            return;
+        }
+        if (current_worker >= 0 && receiver < home.size()) {
+            auto& counter = home[receiver] == (std::uint32_t)current_worker ?
+                counters[current_worker].local : counters[current_worker].remote;
+            counter.fetch_add(1, std::memory_order_relaxed);
+            if (cross_numa(current_worker, home[receiver]))
+                counters[current_worker].cross_numa_sends.fetch_add(1, std::memory_order_relaxed);
+        }
+        schedule(receiver);
+    }
+public:
+
+    /**
+     * Assigns node n to worker workers[n], for every n in the vector; the
+     * other nodes are shared by all the workers. Nodes are handled by their
+     * worker whenever it is not idle, so that the nodes that exchange most
+     * messages should be assigned to the same worker (see partitioner.hpp).
+     * An empty vector removes the assignment. Can only be called while the
+     * manager is not running.
+     */
+    void set_worker_assignment(std::vector<std::uint32_t> workers) {
+        if (running) throw std::runtime_error("Cannot assign nodes to workers while running");
+        for (std::uint32_t w: workers)
+            if (w >= (std::uint32_t)nthreads) throw std::runtime_error("Invalid worker");
+        // Nodes that are already queued are moved to their new queue.
+        node_id_t node;
+        std::vector<node_id_t> queued;
+        for (auto& queue: worker_queues)
+            while (queue->try_dequeue(node)) queued.push_back(node);
+        home = std::move(workers);
+        worker_queues.clear();
+        if (!home.empty()) {
+            for (int i=0; i<nthreads; i++)
+                worker_queues.push_back(std::make_unique<moodycamel::ConcurrentQueue<node_id_t>>());
+        }
+        for (node_id_t n: queued) schedule(n);
+    }
+
+    /**
+     * Returns the worker whose queue the node goes to, or -1 if it is not
+     * assigned to a worker.
+     */
+    int home_worker(node_id_t node) const {
+        return node < home.size() ? home[node] : -1;
+    }
+
+    /**
+     * Returns the number of worker threads.
+     */
+    int worker_count() const {
+        return nthreads;
+    }
+
+    /**
+     * Pins every worker to a CPU, as given by place_workers: workers are then
+     * grouped by NUMA node, and steal work from the workers of their own
+     * node first. Setup code run through on_workers, such as add_nodes of
+     * GraphHardwareManager, allocates the state of the nodes assigned to a
+     * worker on its NUMA node. Can only be called while the manager is not
+     * running.
+     */
+    void pin_workers(const numa_topology& topology) {
+        if (running) throw std::runtime_error("Cannot pin the workers while running");
+        placement = place_workers(topology, nthreads);
+    }
+
+    /**
+     * Returns true if the workers are pinned to CPUs.
+     */
+    bool workers_pinned() const {
+        return !placement.cpu.empty();
+    }
+
+    /**
+     * Returns the NUMA node (an index in the topology given to pin_workers)
+     * of a worker, or 0 if the workers are not pinned.
+     */
+    int worker_numa_node(int worker) const {
+        return workers_pinned() ? placement.node[worker] : 0;
+    }
+
+    /**
+     * Calls f(worker) for every worker, each on its own thread, placed as the
+     * worker is if the workers are pinned, so that the memory f touches
+     * first is allocated on the NUMA node of the worker. The thread-local rng
+     * of each thread is seeded from the seed of the manager and the worker.
+     * The first exception thrown by f is rethrown once all calls are done.
+     */
+    template<typename F>
+    void on_workers(F&& f) {
+        std::exception_ptr error;
+        std::mutex error_mutex;
+        std::vector<std::thread> threads;
+        for (int w=0; w<nthreads; w++) {
+            threads.emplace_back([&, w] () {
+                try {
+                    if (workers_pinned()) pin_thread(placement.cpu[w]);
+                    rng = seeded_rng(seed, w);
+                    f(w);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lck(error_mutex);
+                    if (!error) error = std::current_exception();
+                }
+            });
+        }
+        for (auto& t: threads) t.join();
+        if (error) std::rethrow_exception(error);
+    }
+
+    /**
+     * Messages sent by the workers to nodes assigned to a worker, split by
+     * whether the receiver belongs to the sending worker, and number of
+     * nodes handled by a worker they were not assigned to. With pinned
+     * workers, the sends and the thefts between workers on different NUMA
+     * nodes are counted apart as well.
+     */
+    struct worker_traffic {
+        std::uint64_t local_sends = 0;
+        std::uint64_t remote_sends = 0;
+        std::uint64_t stolen = 0;
+        std::uint64_t cross_numa_sends = 0;
+        std::uint64_t cross_numa_stolen = 0;
+    };
+
+    /**
+     * Returns the traffic of the workers since the creation of the manager.
+     */
+    worker_traffic traffic() const {
+        worker_traffic ans;
+        for (int i=0; i<nthreads; i++) {
+            ans.local_sends += counters[i].local;
+            ans.remote_sends += counters[i].remote;
+            ans.stolen += counters[i].stolen;
+            ans.cross_numa_sends += counters[i].cross_numa_sends;
+            ans.cross_numa_stolen += counters[i].cross_numa_stolen;
+        }
+        return ans;
+    }
+
+    /**
+     * Sets the mailbox configuration of all the nodes, including the ones
+     * that will be added later. Senders read it without locking, so it can
+     * only be called while the manager is not running.
+     */
+    void set_mailbox(const MailboxConfig& config) {
+        if (running) throw std::runtime_error("Cannot change the mailboxes while running");
+        config.check();
+        mailbox = config;
+        epoch_guard g(epochs);
+        nodes.for_each([&config] (node_id_t, Node<T>* nd) {
+            nd->set_mailbox(config);
+            return true;
+        });
+    }
+
+    /**
+     * Sets the mailbox configuration of a single node. Can only be called
+     * while the manager is not running.
+     */
+    void set_mailbox(node_id_t node, const MailboxConfig& config) {
+        if (running) throw std::runtime_error("Cannot change the mailboxes while running");
+        config.check();
+        epoch_guard g(epochs);
+        Node<T>* nd = nodes.find(node);
+        if (nd == nullptr) throw std::runtime_error("Invalid node");
+        nd->set_mailbox(config);
+    }
+
+    /**
+     * Returns the number of messages lost because of full mailboxes.
+     */
+    std::uint64_t dropped_messages() const {
+        return dropped;
+    }
+
+    /**
+     * Returns the number of messages whose sender had to wait for space
+     * in the receiver's mailbox.
+     */
+    std::uint64_t blocked_messages() const {
+        return blocked;
+    }
+
+    /**
+     * Returns the number of messages lost because their sender or their
+     * receiver did not exist anymore, or because their receiver failed
+     * before handling them.
+     */
+    std::uint64_t undelivered_messages() const {
+        return undelivered;
     }
 
     /**
-     * Makes a node fail.
+     * Returns the number of nodes.
+     */
+    std::size_t size() const {
+        epoch_guard g(epochs);
+        return nodes.size();
+    }
+
+    /**
+     * Makes a node fail. It is safe to call this while the workers are
+     * running: the node is removed immediately, and destroyed (dropping
+     * its queued messages) once no worker can be using it anymore.
      */
     void fail(node_id_t node) {
-        if (!nodes.count(node)) throw std::runtime_error("Invalid node");
-        run_lock lck(this);
-        nodes.erase(node);
+        Node<T>* nd;
+        {
+            epoch_guard g(epochs);
+            nd = nodes.erase(node, !running);
+        }
+        if (nd == nullptr) throw std::runtime_error("Invalid node");
+        epochs.retire([this, nd] () {
+            std::size_t lost = nd->queued();
+            Node<T>::queued_messages -= lost;
+            undelivered += lost;
+            delete nd;
+            work_done(lost);
+        });
+        epochs.reclaim();
     }
 
     /**
@@ -207,16 +755,18 @@ public:
     }
 
     /**
-     * Generate a new id
+     * Generate a new id. Another thread can take it before it is given to
+     * add_node, which then throws duplicate_node_error.
      *
      * TODO: make this work when there are a lot of nodes
      */
     node_id_t gen_id() {
+        epoch_guard g(epochs);
         if (4 * nodes.size() / 3 >= max_id) {
             throw std::runtime_error("Too many ids generated");
         }
         node_id_t newid = random_id();
-        while (nodes.count(newid)) {
+        while (nodes.find(newid) != nullptr) {
             newid = random_id();
         }
         return newid;
@@ -227,13 +777,32 @@ public:
      *
      * TODO: make this faster when there are very few nodes
      */
-    node_id_t get_random_node() {
+    virtual node_id_t get_random_node() {
+        epoch_guard g(epochs);
         if (nodes.size() == 0) throw std::runtime_error("Empty node list");
         node_id_t id = random_id();
-        while (!has_bigger_id(id)) {
+        node_id_t ans;
+        while (!nodes.lower_bound(id, ans)) {
             id = random_id();
         }
-        return next_id(id);
+        return ans;
+    }
+
+    /**
+     * Registers a new event generator, which will be fired by the workers
+     * while the manager is running.
+     */
+    template<typename gen_t, typename... Args>
+    gen_t& add_generator(Args&&... args) {
+        auto ptr = std::make_unique<gen_t>(std::forward<Args>(args)...);
+        gen_t& ret = *ptr;
+        std::unique_ptr<EventGenerator<T>> gen = std::move(ptr);
+        run_lock lck(this);
+        gen->manager_ = this;
+        gen->next_fire = clock() + gen->next_interval().count();
+        add_work();
+        generators.push_back(std::move(gen));
+        return ret;
     }
 
     /**
@@ -242,41 +811,18 @@ public:
     void run() {
         stopping = false;
         pausing = false;
+        running = true;
         auto workerfun = [&] (int thread_idx) {
             rng = xoroshiro(thread_idx+1, seed);
+            current_worker = thread_idx;
+            try {
+                if (workers_pinned()) pin_thread(placement.cpu[thread_idx]);
+            } catch (std::exception& e) {
+                std::cerr << e.what() << std::endl;
+            }
+            epochs.register_thread();
             running_threads++;
             while (true) {
-                Node<T>* node;
-                node_id_t node_idx;
-                bool was_empty = false;
-                while (!nodes_queue.try_dequeue(node_idx)) {
-                    std::this_thread::sleep_for(std::chrono::microseconds(1));
-                    if (stopping) {
-                        was_empty = true;
-                        break;
-                    }
-                }
-                if (was_empty) break;
-                node = nodes.at(node_idx).get();
-                try {
-                    int num = 0;
-                    while (true) {
-                        if (num++ > 128) {
-                            nodes_queue.enqueue(node->id());
-                            break;
-                        }
-                        int ret = node->handle_one_message();
-                        if (ret == 0) break;
-                        if (ret == 1) continue;
-                        if (ret == -1) {
-                            nodes_queue.enqueue(node->id());
-                            break;
-                        }
-                        throw std::runtime_error("Invalid return value from handle_one_message");
-                    }
-                } catch (std::exception& e) {
-                    std::cerr << e.what() << std::endl;
-                }
                 if (pausing) {
                     running_threads--;
                     while (pausing) {
@@ -285,14 +831,101 @@ public:
                     }
                     running_threads++;
                 }
+                epochs.reclaim();
+                if (!step(thread_idx)) {
+                    if (stopping) break;
+                    std::this_thread::sleep_for(std::chrono::microseconds(1));
+                }
             }
+            epochs.unregister_thread();
+            current_worker = -1;
+            running_threads--;
         };
+        for (auto& gen: generators) {
+            gen->next_fire = clock() + gen->next_interval().count();
+        }
         workers.clear();
         for (int i=0; i<nthreads; i++) {
             workers.emplace_back(workerfun, i);
         }
     }
 
+    /**
+     * Returns true if the workers are running, i.e. if shared state can
+     * only be changed in ways that are safe for concurrent readers.
+     */
+    bool is_running() const {
+        return running;
+    }
+
+    /**
+     * Returns true if no message is waiting to be handled, being handled or
+     * being generated.
+     */
+    bool idle() const {
+        return pending_work == 0;
+    }
+
+    /**
+     * Wakes up the threads blocked in run_until and wait_until_idle, so that
+     * they re-check their condition. Protocols should call this whenever
+     * they change state a run_until predicate depends on.
+     */
+    void notify() {
+        progress++;
+        if (waiters) futex_wake_all(&progress);
+    }
+
+    /**
+     * Blocks until pred returns true or the system is quiescent, starting
+     * the workers if they are not running. Returns the last value of pred.
+     * The predicate is only re-evaluated when notify is called, which happens
+     * automatically every time the system becomes idle.
+     */
+    bool run_until(const std::function<bool()>& pred) {
+        return run_until(pred, std::chrono::nanoseconds(-1));
+    }
+
+    /**
+     * As above, but gives up after the given timeout. A negative timeout
+     * means waiting forever.
+     */
+    bool run_until(const std::function<bool()>& pred, std::chrono::nanoseconds timeout) {
+        if (workers.empty()) run();
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        waiters++;
+        bool ans = false;
+        while (true) {
+            std::uint32_t seen = progress;
+            if ((ans = pred()) || idle()) break;
+            auto left = timeout;
+            if (timeout.count() >= 0) {
+                left = deadline - std::chrono::steady_clock::now();
+                if (left.count() <= 0) break;
+            }
+            futex_wait(&progress, seen, left);
+        }
+        waiters--;
+        return ans;
+    }
+
+    /**
+     * Blocks until no message is left in the system.
+     */
+    void wait_until_idle() {
+        run_until([] () {return false;});
+    }
+
+    /**
+     * Blocks until no message is left in the system, or until the timeout
+     * expires. Returns true if the system is idle.
+     */
+    template<typename D>
+    bool wait_until_idle(const D& timeout) {
+        run_until([] () {return false;}, std::chrono::duration_cast<std::chrono::nanoseconds>(timeout));
+        return idle();
+    }
+
     /**
      * Pauses the handling of messages.
      */
@@ -319,8 +952,17 @@ public:
         for (int i=0; i<nthreads; i++) {
             workers[i].join();
         }
+        workers.clear();
+        running = false;
+    }
+
+    virtual ~HardwareManager() {
+        epochs.reclaim_all();
+        nodes.for_each([] (node_id_t, Node<T>* nd) {
+            delete nd;
+            return true;
+        });
     }
-    virtual ~HardwareManager() = default;
 };
 
 #endif
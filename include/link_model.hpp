@@ -0,0 +1,220 @@
+#ifndef DISTSIM_LINK_MODEL_HPP
+#define DISTSIM_LINK_MODEL_HPP
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "common.hpp"
+
+/**
+ * How the variable part of a link's latency is distributed.
+ */
+enum class JitterDistribution: std::uint8_t {
+    uniform,    // Uniform between 0 and twice the mean.
+    exponential // Exponential with the given mean.
+};
+
+/**
+ * Parses a distribution name: uniform or exponential.
+ */
+inline JitterDistribution parse_jitter_distribution(const std::string& name) {
+    if (name == "uniform") return JitterDistribution::uniform;
+    if (name == "exponential") return JitterDistribution::exponential;
+    throw std::runtime_error("Unknown jitter distribution " + name + "! Valid types are: uniform, exponential");
+}
+
+/**
+ * Latency, bandwidth and loss of a single link, packed in 16 bytes.
+ */
+struct LinkParams {
+    std::uint32_t latency_ns = 0;
+    std::uint32_t jitter_ns = 0;
+    // Serialization delay, in picoseconds per byte; 0 means infinite bandwidth.
+    std::uint32_t ps_per_byte = 0;
+    // Loss probability, in units of 2^-16; 0xFFFF means that every message
+    // is lost.
+    std::uint16_t loss = 0;
+    JitterDistribution jitter_distribution = JitterDistribution::uniform;
+
+    /**
+     * Builds the parameters from human-friendly units. Throws if the
+     * latency or the jitter do not fit in 32 bits of nanoseconds, or if the
+     * bandwidth is too low for 32 bits of picoseconds per byte.
+     */
+    static LinkParams make(
+        std::chrono::nanoseconds latency,
+        std::chrono::nanoseconds jitter = std::chrono::nanoseconds(0),
+        double mbit_per_s = 0,
+        double loss_chance = 0,
+        JitterDistribution distribution = JitterDistribution::uniform
+    ) {
+        const long long max_ns = std::numeric_limits<std::uint32_t>::max();
+        if (latency.count() < 0 || latency.count() > max_ns || jitter.count() < 0 || jitter.count() > max_ns)
+            throw std::runtime_error("Link latency and jitter must be between 0 and " + std::to_string(max_ns) + " ns");
+        double ps_per_byte = mbit_per_s > 0 ? 8e6 / mbit_per_s : 0;
+        if (ps_per_byte > std::numeric_limits<std::uint32_t>::max())
+            throw std::runtime_error("Link bandwidth must be at least " + std::to_string(8e6 / max_ns) + " Mbit/s");
+        LinkParams p;
+        p.latency_ns = latency.count();
+        p.jitter_ns = jitter.count();
+        p.ps_per_byte = std::lround(ps_per_byte);
+        p.loss = std::lround(std::clamp(loss_chance, 0.0, 1.0) * 0xFFFF);
+        p.jitter_distribution = distribution;
+        return p;
+    }
+
+    /**
+     * Returns true if the link adds no delay and loses no message.
+     */
+    bool ideal() const {
+        return latency_ns == 0 && jitter_ns == 0 && ps_per_byte == 0 && loss == 0;
+    }
+
+    /**
+     * Decides whether a message is lost. Uses the top 16 bits of r.
+     */
+    bool lost(std::uint64_t r) const {
+        return loss == 0xFFFF || (r >> 48) < loss;
+    }
+
+    /**
+     * Computes the delay of a message of the given size. Uses the low 48
+     * bits of r, so that a single random number can be used for both
+     * this and lost.
+     */
+    std::chrono::nanoseconds delay(std::uint64_t r, std::size_t bytes) const {
+        std::uint64_t ns = latency_ns + (std::uint64_t)ps_per_byte * bytes / 1000;
+        if (jitter_ns) {
+            // Uniform in (0, 1].
+            double u = ((r & ((1ULL<<48)-1)) + 1) * 0x1.0p-48;
+            if (jitter_distribution == JitterDistribution::uniform) ns += 2 * jitter_ns * u;
+            else ns += -std::log(u) * jitter_ns;
+        }
+        return std::chrono::nanoseconds(ns);
+    }
+};
+static_assert(sizeof(LinkParams) == 16, "LinkParams should stay compact");
+
+/**
+ * Per-link parameters of a graph. Only the links whose parameters differ
+ * from the default ones are stored, in per-node arrays sorted by the other
+ * endpoint. Undirected links are stored once, under the smaller endpoint.
+ */
+template <bool directed = false>
+class LinkTable {
+    LinkParams default_params;
+    std::vector<std::vector<node_id_t>> targets;
+    std::vector<std::vector<LinkParams>> params;
+    bool empty_ = true;
+
+    static std::pair<node_id_t, node_id_t> key(node_id_t a, node_id_t b) {
+        if (!directed && b < a) std::swap(a, b);
+        return {a, b};
+    }
+public:
+    /**
+     * Sets the parameters of the links that were not given any.
+     */
+    void set_default(const LinkParams& p) {
+        default_params = p;
+        empty_ = false;
+    }
+
+    /**
+     * Sets the parameters of the link between a and b. Each call takes
+     * time linear in the links of the node, so set_many should be used to
+     * load many links.
+     */
+    void set(node_id_t a, node_id_t b, const LinkParams& p) {
+        auto [from, to] = key(a, b);
+        if (targets.size() <= from) {
+            targets.resize(from+1);
+            params.resize(from+1);
+        }
+        auto& tg = targets[from];
+        auto pos = std::lower_bound(tg.begin(), tg.end(), to) - tg.begin();
+        if (pos != (long)tg.size() && tg[pos] == to) {
+            params[from][pos] = p;
+        } else {
+            tg.insert(tg.begin()+pos, to);
+            params[from].insert(params[from].begin()+pos, p);
+        }
+        empty_ = false;
+    }
+
+    /**
+     * Sets the parameters of a batch of links, given as (a, b, parameters).
+     * Unlike repeated calls to set, this sorts every node's links only once,
+     * so that it takes O(L log L) time for L links even when they come in
+     * no particular order. If a link appears more than once, the last
+     * parameters win.
+     */
+    void set_many(std::vector<std::tuple<node_id_t, node_id_t, LinkParams>> batch) {
+        if (batch.empty()) return;
+        for (auto& [a, b, p]: batch) std::tie(a, b) = key(a, b);
+        std::stable_sort(batch.begin(), batch.end(), [] (const auto& x, const auto& y) {
+            return std::tie(std::get<0>(x), std::get<1>(x)) < std::tie(std::get<0>(y), std::get<1>(y));
+        });
+        node_id_t max_from = std::get<0>(batch.back());
+        if (targets.size() <= max_from) {
+            targets.resize(max_from+1);
+            params.resize(max_from+1);
+        }
+        std::vector<node_id_t> tg;
+        std::vector<LinkParams> pr;
+        for (std::size_t i=0; i<batch.size(); ) {
+            node_id_t from = std::get<0>(batch[i]);
+            // Merges the batch into the sorted links of the node.
+            const auto& old_tg = targets[from];
+            const auto& old_pr = params[from];
+            tg.clear();
+            pr.clear();
+            std::size_t k = 0;
+            for (; i<batch.size() && std::get<0>(batch[i]) == from; i++) {
+                node_id_t to = std::get<1>(batch[i]);
+                for (; k<old_tg.size() && old_tg[k] < to; k++) {
+                    tg.push_back(old_tg[k]);
+                    pr.push_back(old_pr[k]);
+                }
+                if (k<old_tg.size() && old_tg[k] == to) k++;
+                if (!tg.empty() && tg.back() == to) {
+                    pr.back() = std::get<2>(batch[i]);
+                } else {
+                    tg.push_back(to);
+                    pr.push_back(std::get<2>(batch[i]));
+                }
+            }
+            tg.insert(tg.end(), old_tg.begin()+k, old_tg.end());
+            pr.insert(pr.end(), old_pr.begin()+k, old_pr.end());
+            targets[from].assign(tg.begin(), tg.end());
+            params[from].assign(pr.begin(), pr.end());
+        }
+        empty_ = false;
+    }
+
+    /**
+     * Returns the parameters of the link between a and b.
+     */
+    const LinkParams& get(node_id_t a, node_id_t b) const {
+        auto [from, to] = key(a, b);
+        if (targets.size() <= from) return default_params;
+        const auto& tg = targets[from];
+        auto it = std::lower_bound(tg.begin(), tg.end(), to);
+        if (it == tg.end() || *it != to) return default_params;
+        return params[from][it - tg.begin()];
+    }
+
+    /**
+     * Returns true if every link is ideal, i.e. no parameter was ever set.
+     */
+    bool empty() const {
+        return empty_;
+    }
+};
+
+#endif
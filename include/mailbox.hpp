@@ -0,0 +1,56 @@
+#ifndef DISTSIM_MAILBOX_HPP
+#define DISTSIM_MAILBOX_HPP
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+/**
+ * What happens to a message sent to a node whose mailbox is full.
+ */
+enum class MailboxPolicy {
+    tail_drop,         // The new message is lost.
+    head_drop,         // The oldest queued message is lost.
+    random_early_drop, // New messages are lost with a probability that grows with the queue.
+    backpressure       // The sender waits for some space, and the message is lost on timeout.
+};
+
+/**
+ * Capacity and overflow policy of a node's mailbox.
+ */
+struct MailboxConfig {
+    std::size_t capacity = std::numeric_limits<std::size_t>::max();
+    MailboxPolicy policy = MailboxPolicy::tail_drop;
+    // With random_early_drop, the drop probability grows linearly from 0
+    // when red_threshold messages are queued to 1 when the mailbox is full.
+    std::size_t red_threshold = 0;
+    // With backpressure, how long a sender waits before giving up. Workers
+    // do not wait for nodes that only they handle, which could not drain,
+    // and neither does the transport of a sharded simulation.
+    std::chrono::nanoseconds backpressure_timeout = std::chrono::milliseconds(1);
+
+    bool bounded() const {
+        return capacity != std::numeric_limits<std::size_t>::max();
+    }
+
+    /**
+     * Throws if the configuration is not valid.
+     */
+    void check() const {
+        if (capacity == 0) throw std::runtime_error("A mailbox must hold at least one message");
+    }
+};
+
+/**
+ * Parses a policy name: tail, head, red or backpressure.
+ */
+inline MailboxPolicy parse_mailbox_policy(const std::string& name) {
+    if (name == "tail") return MailboxPolicy::tail_drop;
+    if (name == "head") return MailboxPolicy::head_drop;
+    if (name == "red") return MailboxPolicy::random_early_drop;
+    if (name == "backpressure") return MailboxPolicy::backpressure;
+    throw std::runtime_error("Unknown mailbox policy " + name + "! Valid policies are: tail, head, red, backpressure");
+}
+
+#endif
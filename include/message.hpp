@@ -9,13 +9,23 @@
 template <typename T> // T should be default constructible
 class Message {
     friend class HardwareManager<T>;
+    friend class Node<T>;
     std::size_t hops;
     std::chrono::nanoseconds delay_;
+    // Delay added by the link the message is travelling on. It is set again
+    // on every send, so it never accumulates across hops.
+    std::chrono::nanoseconds link_delay_;
+    std::size_t size_;
     T data_;
 public:
-    Message(const T& data): hops(0), delay_(0), data_(data) {}
-    Message(): hops(0), delay_(0) {}
+    Message(const T& data): hops(0), delay_(0), link_delay_(0), size_(sizeof(T)), data_(data) {}
+    Message(): hops(0), delay_(0), link_delay_(0), size_(sizeof(T)) {}
     std::size_t get_hops() {return hops;}
+    /**
+     * Size of the message in bytes, used to compute serialization delays.
+     */
+    std::size_t size() const {return size_;}
+    void size(std::size_t bytes) {size_ = bytes;}
     template<typename D>
     void delay(const D& new_delay) {
         delay_ = std::chrono::duration_cast<std::chrono::nanoseconds>(new_delay);
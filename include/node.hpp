@@ -6,6 +6,8 @@
 #include "common.hpp"
 #include "hardware_manager.hpp"
 #include "message.hpp"
+#include "mailbox.hpp"
+#include "rng.hpp"
 
 using namespace std::chrono;
 
@@ -20,11 +22,14 @@ private:
     node_id_t id_;
 
     typedef std::pair<time_point<high_resolution_clock>, Message<T>> p_msg_t;
-    // Simple queue for undelayed messages
-    std::queue<Message<T>> messages;
+    // Simple queue for undelayed messages, with their arrival times
+    std::queue<p_msg_t> messages;
     // Min-heap for delayed messages
     std::priority_queue<p_msg_t, std::vector<p_msg_t>, std::greater<p_msg_t>> delayed_messages;
     std::mutex messages_mutex;
+    // Total size of the two queues, readable without locking.
+    std::atomic<std::size_t> queue_size{0};
+    MailboxConfig mailbox_;
 
     /**
      * Gets a message from the queue and dispatches it to handle_message.
@@ -40,20 +45,68 @@ private:
         {
             std::lock_guard<std::mutex> lck{messages_mutex};
             if (messages.size() != 0) {
-                msg = std::move(messages.front());
+                msg = std::move(messages.front().second);
                 messages.pop();
-                queued_messages--;
             } else if (delayed_messages.size() != 0) {
                 if (delayed_messages.top().first > now) return -1;
                 msg = delayed_messages.top().second;
                 delayed_messages.pop();
-                queued_messages--;
             } else return 0;
+            queue_size--;
+            queued_messages--;
         }
+        // The message is accounted as done even if its handler throws.
+        struct done_guard {
+            HardwareManager<T>* manager;
+            ~done_guard() {manager->work_done();}
+        } guard{manager_};
         handle_message(std::move(msg.value()));
         return 1;
     }
 
+    /**
+     * Returns the number of messages in the queues.
+     */
+    std::size_t queued() const {
+        return queue_size;
+    }
+
+    /**
+     * Returns true if the mailbox is at its capacity.
+     */
+    bool full() const {
+        return queue_size >= mailbox_.capacity;
+    }
+
+    /**
+     * Changes the mailbox configuration.
+     */
+    void set_mailbox(const MailboxConfig& config) {
+        std::lock_guard<std::mutex> lck{messages_mutex};
+        mailbox_ = config;
+    }
+
+    /**
+     * Drops the oldest message in the queues, comparing the arrival time at
+     * the head of the undelayed queue with the delivery time at the head of
+     * the delayed one. Returns false if they are empty. Called with the
+     * queues locked.
+     */
+    bool drop_oldest() {
+        bool undelayed = messages.size() != 0;
+        bool delayed = delayed_messages.size() != 0;
+        if (undelayed && delayed)
+            undelayed = messages.front().first <= delayed_messages.top().first;
+        if (undelayed) messages.pop();
+        else if (delayed) delayed_messages.pop();
+        else return false;
+        queue_size--;
+        queued_messages--;
+        manager_->dropped++;
+        manager_->work_done();
+        return true;
+    }
+
 protected:
     /**
      * Creates a new message's content and (possibly) sends it.
@@ -61,10 +114,20 @@ protected:
     virtual void start_message(Message<T> msg) = 0;
 
     /**
-     * Checks if we can enqueue a message
+     * Checks if we can enqueue a message, applying the overflow policy
+     * of the mailbox. Called with the queues locked.
      */
     virtual bool check_enqueue() {
-        return true;
+        std::size_t size = queue_size;
+        if (size < mailbox_.capacity) {
+            if (mailbox_.policy != MailboxPolicy::random_early_drop || size < mailbox_.red_threshold)
+                return true;
+            double drop_chance = double(size - mailbox_.red_threshold) / (mailbox_.capacity - mailbox_.red_threshold);
+            return rng() >= drop_chance * xoroshiro::max();
+        }
+        // Without an older message to make room for it, the new one is lost.
+        if (mailbox_.policy == MailboxPolicy::head_drop) return drop_oldest();
+        return false;
     }
 
     /**
@@ -77,6 +140,21 @@ protected:
      */
     virtual void init() {}
 
+    /**
+     * Handles a timer scheduled with schedule_timer. It may run concurrently
+     * with handle_message.
+     */
+    virtual void handle_timer(std::uint64_t token) {}
+
+    /**
+     * Schedules a call to handle_timer with the given token after the
+     * given delay.
+     */
+    template<typename D>
+    void schedule_timer(const D& delay, std::uint64_t token) {
+        manager_->schedule_timer(id_, std::chrono::duration_cast<std::chrono::nanoseconds>(delay), token);
+    }
+
     /**
      * Gets the node's id.
      */
@@ -92,24 +170,31 @@ protected:
      */
     Node(HardwareManager<T>* manager, node_id_t id): manager_(manager), id_(id) {}
 
-     /**
+    /**
      * Adds a message to the queue. If the message cannot be enqueued,
-     * it is lost.
+     * it is lost and false is returned.
      */
-    void enqueue(Message<T> msg) {
+    bool enqueue(Message<T> msg) {
         auto now = high_resolution_clock::now();
         std::lock_guard<std::mutex> lck{messages_mutex};
-        if (check_enqueue()) {
-            if (msg.delay().count() == 0) {
-                queued_messages++;
-                all_messages++;
-                messages.push(msg);
-            } else {
-                queued_messages++;
-                all_messages++;
-                delayed_messages.emplace(now + msg.delay(), msg);
-            }
+        // Must happen before the message becomes visible to the workers.
+        manager_->add_work();
+        if (!check_enqueue()) {
+            manager_->work_done();
+            return false;
+        }
+        queue_size++;
+        auto delay = msg.delay() + msg.link_delay_;
+        if (delay.count() == 0) {
+            queued_messages++;
+            all_messages++;
+            messages.emplace(now, msg);
+        } else {
+            queued_messages++;
+            all_messages++;
+            delayed_messages.emplace(now + delay, msg);
         }
+        return true;
     }
 public:
     virtual ~Node() = default;
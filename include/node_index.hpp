@@ -0,0 +1,206 @@
+#ifndef DISTSIM_NODE_INDEX_HPP
+#define DISTSIM_NODE_INDEX_HPP
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "common.hpp"
+#include "epoch.hpp"
+
+/**
+ * Ordered map from node ids to nodes that can be read without locks while
+ * nodes are added and removed.
+ *
+ * Readers see an immutable snapshot, made of a large sorted base array that
+ * is shared between snapshots and a small sorted delta with the changes
+ * since the base was built (a null pointer marks a removed node). Writers
+ * are serialized; each of them publishes a new snapshot with an updated
+ * copy of the delta, and folds the delta into a new base once it grows past
+ * about sqrt(N) entries, so that updates cost O(sqrt(N)) amortized.
+ * Old snapshots are reclaimed through the given EpochManager, so every
+ * read must happen inside one of its critical sections.
+ */
+template <typename V>
+class NodeIndex {
+    struct base_t {
+        std::vector<node_id_t> ids;
+        std::vector<V*> values;
+    };
+    struct snapshot_t {
+        std::shared_ptr<const base_t> base;
+        std::vector<node_id_t> ids;
+        std::vector<V*> values;
+        std::size_t size = 0;
+    };
+
+    EpochManager& epochs;
+    std::atomic<snapshot_t*> current;
+    std::mutex writer;
+
+    static V* const* find_in(const std::vector<node_id_t>& ids, const std::vector<V*>& values, node_id_t id) {
+        auto it = std::lower_bound(ids.begin(), ids.end(), id);
+        if (it == ids.end() || *it != id) return nullptr;
+        return &values[it - ids.begin()];
+    }
+
+    static V* find_in(const snapshot_t* s, node_id_t id) {
+        if (auto d = find_in(s->ids, s->values, id)) return *d;
+        if (auto b = find_in(s->base->ids, s->base->values, id)) return *b;
+        return nullptr;
+    }
+
+    /**
+     * Returns the snapshot to modify: the current one if nobody else can
+     * read it, a copy otherwise.
+     */
+    snapshot_t* writable(bool exclusive) {
+        snapshot_t* s = current.load();
+        if (exclusive) return s;
+        return new snapshot_t(*s);
+    }
+
+    void publish(snapshot_t* s, bool exclusive) {
+        std::size_t limit = 64 + std::sqrt((double)s->base->ids.size());
+        if (s->ids.size() > limit) {
+            auto base = std::make_shared<base_t>();
+            base->ids.reserve(s->size);
+            base->values.reserve(s->size);
+            for_each_in(s, [&base] (node_id_t id, V* v) {
+                base->ids.push_back(id);
+                base->values.push_back(v);
+                return true;
+            });
+            s->base = std::move(base);
+            s->ids.clear();
+            s->values.clear();
+        }
+        if (exclusive) return;
+        snapshot_t* old = current.exchange(s);
+        epochs.retire([old] () {delete old;});
+    }
+
+    template<typename F>
+    static void for_each_in(const snapshot_t* s, F&& fun, node_id_t from = 0) {
+        const auto& b = *s->base;
+        std::size_t i = std::lower_bound(b.ids.begin(), b.ids.end(), from) - b.ids.begin();
+        std::size_t j = std::lower_bound(s->ids.begin(), s->ids.end(), from) - s->ids.begin();
+        while (i < b.ids.size() || j < s->ids.size()) {
+            node_id_t id;
+            V* v;
+            if (j == s->ids.size() || (i < b.ids.size() && b.ids[i] < s->ids[j])) {
+                id = b.ids[i];
+                v = b.values[i++];
+            } else {
+                if (i < b.ids.size() && b.ids[i] == s->ids[j]) i++;
+                id = s->ids[j];
+                v = s->values[j++];
+            }
+            if (v != nullptr && !fun(id, v)) return;
+        }
+    }
+public:
+    NodeIndex(EpochManager& epochs): epochs(epochs), current(new snapshot_t) {
+        current.load()->base = std::make_shared<base_t>();
+    }
+    NodeIndex(const NodeIndex&) = delete;
+    NodeIndex& operator=(const NodeIndex&) = delete;
+
+    /**
+     * Returns the value associated to id, or null if there is none.
+     */
+    V* find(node_id_t id) const {
+        return find_in(current.load(std::memory_order_acquire), id);
+    }
+
+    /**
+     * Returns the number of nodes.
+     */
+    std::size_t size() const {
+        return current.load(std::memory_order_acquire)->size;
+    }
+
+    /**
+     * Finds the smallest id bigger than or equal to i. Returns false if
+     * there is none.
+     */
+    bool lower_bound(node_id_t i, node_id_t& ans) const {
+        bool found = false;
+        for_each_in(current.load(std::memory_order_acquire), [&] (node_id_t id, V*) {
+            ans = id;
+            found = true;
+            return false;
+        }, i);
+        return found;
+    }
+
+    /**
+     * Calls fun(id, value) on every node in id order, until it returns false.
+     */
+    template<typename F>
+    void for_each(F&& fun) const {
+        for_each_in(current.load(std::memory_order_acquire), fun);
+    }
+
+    /**
+     * Adds a node. Returns false if the id was already present. If
+     * exclusive is true, the caller guarantees that there are no
+     * concurrent readers, and the update is done in place.
+     */
+    bool insert(node_id_t id, V* value, bool exclusive) {
+        std::lock_guard<std::mutex> lck(writer);
+        snapshot_t* cur = current.load();
+        if (find_in(cur, id) != nullptr) return false;
+        snapshot_t* s = writable(exclusive);
+        auto& base = s->base->ids;
+        if (s->ids.empty() && (base.empty() || base.back() < id) && exclusive && s->base.use_count() == 1) {
+            // Fast path for nodes added in increasing id order.
+            auto b = std::const_pointer_cast<base_t>(s->base);
+            b->ids.push_back(id);
+            b->values.push_back(value);
+        } else {
+            auto pos = std::lower_bound(s->ids.begin(), s->ids.end(), id) - s->ids.begin();
+            if (pos != (long)s->ids.size() && s->ids[pos] == id) {
+                s->values[pos] = value;
+            } else {
+                s->ids.insert(s->ids.begin()+pos, id);
+                s->values.insert(s->values.begin()+pos, value);
+            }
+        }
+        s->size++;
+        publish(s, exclusive);
+        return true;
+    }
+
+    /**
+     * Removes a node, returning its value, or null if it was not there.
+     * The value must be retired by the caller.
+     */
+    V* erase(node_id_t id, bool exclusive) {
+        std::lock_guard<std::mutex> lck(writer);
+        V* value = find_in(current.load(), id);
+        if (value == nullptr) return nullptr;
+        snapshot_t* s = writable(exclusive);
+        auto pos = std::lower_bound(s->ids.begin(), s->ids.end(), id) - s->ids.begin();
+        if (pos != (long)s->ids.size() && s->ids[pos] == id) {
+            if (find_in(s->base->ids, s->base->values, id)) s->values[pos] = nullptr;
+            else {
+                s->ids.erase(s->ids.begin()+pos);
+                s->values.erase(s->values.begin()+pos);
+            }
+        } else {
+            s->ids.insert(s->ids.begin()+pos, id);
+            s->values.insert(s->values.begin()+pos, nullptr);
+        }
+        s->size--;
+        publish(s, exclusive);
+        return value;
+    }
+
+    ~NodeIndex() {
+        delete current.load();
+    }
+};
+
+#endif
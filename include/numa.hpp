@@ -0,0 +1,130 @@
+#ifndef DISTSIM_NUMA_HPP
+#define DISTSIM_NUMA_HPP
+#include <algorithm>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Parses a list of CPUs in the format of the kernel, such as "0-3,8,10-11".
+ */
+inline std::vector<int> parse_cpu_list(const std::string& list) {
+    std::vector<int> cpus;
+    std::size_t pos = 0;
+    while (pos < list.size()) {
+        std::size_t end = list.find(',', pos);
+        if (end == std::string::npos) end = list.size();
+        std::string range = list.substr(pos, end - pos);
+        pos = end + 1;
+        if (range.find_first_not_of(" \n") == std::string::npos) continue;
+        std::size_t dash = range.find('-');
+        int first = std::atoi(range.c_str());
+        int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+        for (int c=first; c<=last; c++) cpus.push_back(c);
+    }
+    return cpus;
+}
+
+/**
+ * The NUMA nodes of the machine and the CPUs of each of them that the
+ * process may run on.
+ */
+struct numa_topology {
+    std::vector<int> nodes;
+    std::vector<std::vector<int>> cpus;
+
+    std::size_t cpu_count() const {
+        std::size_t ans = 0;
+        for (const auto& c: cpus) ans += c.size();
+        return ans;
+    }
+};
+
+/**
+ * Reads the topology from /sys/devices/system/node, leaving out the CPUs
+ * the process is not allowed to run on and the nodes without CPUs. If it
+ * is not available, all the CPUs are put in node 0.
+ */
+inline numa_topology read_numa_topology() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        throw std::runtime_error("Could not read the CPU affinity");
+    std::vector<int> node_ids;
+    if (DIR* dir = opendir("/sys/devices/system/node")) {
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.compare(0, 4, "node") == 0 && name.size() > 4 &&
+                name.find_first_not_of("0123456789", 4) == std::string::npos)
+                node_ids.push_back(std::atoi(name.c_str() + 4));
+        }
+        closedir(dir);
+    }
+    std::sort(node_ids.begin(), node_ids.end());
+    numa_topology topology;
+    for (int node: node_ids) {
+        std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        std::getline(in, list);
+        std::vector<int> cpus;
+        for (int c: parse_cpu_list(list))
+            if (c < CPU_SETSIZE && CPU_ISSET(c, &allowed)) cpus.push_back(c);
+        if (cpus.empty()) continue;
+        topology.nodes.push_back(node);
+        topology.cpus.push_back(std::move(cpus));
+    }
+    if (topology.nodes.empty()) {
+        std::vector<int> cpus;
+        for (int c=0; c<CPU_SETSIZE; c++)
+            if (CPU_ISSET(c, &allowed)) cpus.push_back(c);
+        topology.nodes.push_back(0);
+        topology.cpus.push_back(std::move(cpus));
+    }
+    return topology;
+}
+
+/**
+ * The CPU and the NUMA node (an index in numa_topology::nodes) of each
+ * worker.
+ */
+struct worker_placement {
+    std::vector<int> cpu;
+    std::vector<int> node;
+};
+
+/**
+ * Places the workers on the CPUs of the topology, node after node, so that
+ * consecutive workers share a node. If there are more workers than CPUs,
+ * consecutive workers share a CPU.
+ */
+inline worker_placement place_workers(const numa_topology& topology, int workers) {
+    worker_placement ans;
+    std::size_t total = topology.cpu_count();
+    if (total == 0) throw std::runtime_error("No CPU to place the workers on");
+    for (int w=0; w<workers; w++) {
+        std::size_t c = (std::size_t)workers <= total ? w : w * total / workers;
+        int node = 0;
+        while (c >= topology.cpus[node].size()) c -= topology.cpus[node++].size();
+        ans.cpu.push_back(topology.cpus[node][c]);
+        ans.node.push_back(node);
+    }
+    return ans;
+}
+
+/**
+ * Restricts the calling thread to the given CPU. Memory it touches first is
+ * then allocated on the NUMA node of that CPU, under the default policy.
+ */
+inline void pin_thread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        throw std::runtime_error("Could not pin the thread to CPU " + std::to_string(cpu));
+}
+#endif
@@ -0,0 +1,49 @@
+#ifndef DISTSIM_PARALLEL_HPP
+#define DISTSIM_PARALLEL_HPP
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Calls f(i) for every i in [0, n), on nthreads threads (-1 means one per
+ * core). Indexes are handed out one at a time, so uneven work is balanced.
+ * The first exception thrown by f is rethrown once all threads are done.
+ */
+template<typename F>
+void parallel_for(std::uint64_t n, int nthreads, F&& f) {
+    if (nthreads == -1) nthreads = std::thread::hardware_concurrency();
+    nthreads = std::max<std::int64_t>(1, std::min<std::int64_t>(nthreads, n));
+    std::atomic<std::uint64_t> next{0};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto work = [&] () {
+        try {
+            for (std::uint64_t i = next++; i < n; i = next++) f(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lck(error_mutex);
+            if (!error) error = std::current_exception();
+            next = n;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int t=1; t<nthreads; t++) threads.emplace_back(work);
+    work();
+    for (auto& t: threads) t.join();
+    if (error) std::rethrow_exception(error);
+}
+
+/**
+ * Calls f(first, last) for consecutive ranges of at most block indexes that
+ * cover [0, n), on nthreads threads as in parallel_for.
+ */
+template<typename F>
+void parallel_for_ranges(std::uint64_t n, std::uint64_t block, int nthreads, F&& f) {
+    parallel_for((n + block - 1) / block, nthreads, [&] (std::uint64_t r) {
+        f(r * block, std::min(n, (r+1) * block));
+    });
+}
+#endif
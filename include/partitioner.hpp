@@ -0,0 +1,158 @@
+#ifndef DISTSIM_PARTITIONER_HPP
+#define DISTSIM_PARTITIONER_HPP
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "common.hpp"
+
+namespace partitioner_detail {
+/**
+ * One or more passes of a streaming partitioner over the nodes of the
+ * graph, visited in the given order (all of them in id order if it is
+ * empty). Each node goes to the part with the best score(neighbours, size),
+ * with neighbours the number of its neighbours already in the part, among
+ * the parts with fewer than slack * nodes / parts nodes; ties go to the
+ * smallest part. Later passes move every node again, seeing where all the
+ * others are.
+ */
+template<typename Graph, typename Score>
+std::vector<std::uint32_t> stream(const Graph& graph, std::uint32_t parts, const std::vector<node_id_t>& order,
+                                  int passes, double slack, Score&& score) {
+    std::uint64_t nodes = graph.nodes();
+    if (parts == 0) throw std::runtime_error("Cannot partition in 0 parts");
+    if (!order.empty() && order.size() != nodes) throw std::runtime_error("The order does not match the graph");
+    std::uint64_t capacity = std::max<std::uint64_t>(1, std::ceil(slack * nodes / parts));
+    std::vector<std::uint32_t> part(nodes, parts);
+    std::vector<std::uint64_t> size(parts), neighbours(parts);
+    std::vector<std::uint32_t> touched;
+    for (int pass=0; pass<passes; pass++) {
+        for (std::uint64_t i=0; i<nodes; i++) {
+            node_id_t n = order.empty() ? i : order[i];
+            if (part[n] != parts) size[part[n]]--;
+            touched.clear();
+            for (auto t=graph.neighbours_begin(n); t!=graph.neighbours_end(n); t++) {
+                std::uint32_t p = part[*t];
+                if (p == parts || *t == n) continue;
+                if (neighbours[p]++ == 0) touched.push_back(p);
+            }
+            // Scores decrease with the size of the part, so among the parts
+            // without neighbours, the smallest is the best.
+            std::uint32_t best = parts;
+            for (std::uint32_t p=0; p<parts; p++) {
+                if (size[p] >= capacity) continue;
+                if (best == parts || size[p] < size[best]) best = p;
+            }
+            double best_score = score(neighbours[best], size[best]);
+            for (std::uint32_t p: touched) {
+                if (size[p] >= capacity) continue;
+                double s = score(neighbours[p], size[p]);
+                if (s > best_score || (s == best_score && size[p] < size[best])) {
+                    best = p;
+                    best_score = s;
+                }
+            }
+            for (std::uint32_t p: touched) neighbours[p] = 0;
+            part[n] = best;
+            size[best]++;
+        }
+    }
+    return part;
+}
+}
+
+/**
+ * Partitions the nodes of a graph in CSR form (csr_graph or mapped_graph)
+ * with Linear Deterministic Greedy: nodes are streamed in the given order,
+ * and each goes to the part that holds most of its neighbours, weighted by
+ * the room left in the part. Returns the part of every node.
+ *
+ * Streaming partitioners see each node once, so they take linear time, but
+ * their cuts depend on the order: a breadth-first order such as rcm_order
+ * puts neighbours close in the stream. Restreaming, with more passes,
+ * improves the cut.
+ */
+template<typename Graph>
+std::vector<std::uint32_t> ldg_partition(const Graph& graph, std::uint32_t parts,
+                                         const std::vector<node_id_t>& order={}, int passes=1) {
+    double capacity = std::max<double>(1, std::ceil(1.05 * graph.nodes() / parts));
+    return partitioner_detail::stream(graph, parts, order, passes, 1.05, [=] (std::uint64_t neighbours, std::uint64_t size) {
+        return neighbours * (1 - size / capacity);
+    });
+}
+
+/**
+ * Partitions the nodes of a graph with Fennel, which streams them as
+ * ldg_partition but charges a part of size s a cost of alpha * gamma *
+ * s^(gamma-1), with gamma = 1.5 and alpha = sqrt(parts) * edges /
+ * nodes^1.5, instead of scaling the neighbours it holds. This cuts fewer
+ * edges on power-law graphs.
+ */
+template<typename Graph>
+std::vector<std::uint32_t> fennel_partition(const Graph& graph, std::uint32_t parts,
+                                            const std::vector<node_id_t>& order={}, int passes=1) {
+    const double gamma = 1.5;
+    double nodes = std::max<double>(1, graph.nodes());
+    double alpha = std::sqrt(parts) * (graph.arcs() / 2.0) / std::pow(nodes, gamma);
+    return partitioner_detail::stream(graph, parts, order, passes, 1.1, [=] (std::uint64_t neighbours, std::uint64_t size) {
+        return neighbours - alpha * gamma * std::sqrt((double)size);
+    });
+}
+
+/**
+ * Splits the nodes in parts of consecutive positions in the given order
+ * (in id order if it is empty), which is a good partition if the order
+ * keeps neighbours close.
+ */
+inline std::vector<std::uint32_t> block_partition(std::uint64_t nodes, std::uint32_t parts,
+                                                  const std::vector<node_id_t>& order={}) {
+    std::vector<std::uint32_t> part(nodes);
+    for (std::uint64_t i=0; i<nodes; i++)
+        part[order.empty() ? i : order[i]] = i * parts / nodes;
+    return part;
+}
+
+static const char* const partitioner_names = "blocks, ldg, fennel";
+
+/**
+ * Returns the partition of the graph in the given number of parts with the
+ * given partitioner (one of partitioner_names), streaming nodes in the given
+ * order.
+ */
+template<typename Graph>
+std::vector<std::uint32_t> partition_graph(const std::string& name, const Graph& graph, std::uint32_t parts,
+                                           const std::vector<node_id_t>& order={}) {
+    if (name == "blocks") return block_partition(graph.nodes(), parts, order);
+    if (name == "ldg") return ldg_partition(graph, parts, order);
+    if (name == "fennel") return fennel_partition(graph, parts, order);
+    throw std::runtime_error("Unknown partitioner " + name + "! Valid partitioners are: " + partitioner_names);
+}
+
+/**
+ * Fraction of the edges whose ends are in different parts, and size of the
+ * largest part relative to the average.
+ */
+struct partition_quality {
+    double cut_ratio = 0;
+    double imbalance = 0;
+};
+
+/**
+ * Returns the quality of a partition, as returned by partition_graph.
+ */
+template<typename Graph>
+partition_quality evaluate_partition(const Graph& graph, const std::vector<std::uint32_t>& part, std::uint32_t parts) {
+    partition_quality ans;
+    std::uint64_t nodes = graph.nodes(), cut = 0;
+    std::vector<std::uint64_t> size(parts);
+    for (std::uint64_t n=0; n<nodes; n++) {
+        size[part[n]]++;
+        for (auto t=graph.neighbours_begin(n); t!=graph.neighbours_end(n); t++) cut += part[*t] != part[n];
+    }
+    if (graph.arcs()) ans.cut_ratio = (double)cut / graph.arcs();
+    if (nodes) ans.imbalance = (double)*std::max_element(size.begin(), size.end()) * parts / nodes;
+    return ans;
+}
+#endif
@@ -0,0 +1,66 @@
+#ifndef DISTSIM_PERF_COUNTERS_HPP
+#define DISTSIM_PERF_COUNTERS_HPP
+#include <cstdint>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * A hardware or software event counter of the kernel (see perf_event_open),
+ * counting in user space for the calling thread and the threads it starts
+ * afterwards. The counts of those threads are only added once they exit.
+ * Counters are often not available, for example in virtual machines or
+ * when perf_event_paranoid forbids them, and then available() is false.
+ */
+class perf_counter {
+    int fd;
+public:
+    perf_counter(const perf_counter&) = delete;
+    perf_counter& operator=(const perf_counter&) = delete;
+
+    perf_counter(std::uint32_t type, std::uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    /**
+     * Counts the misses of the last level cache.
+     */
+    static perf_counter cache_misses() {
+        return perf_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    }
+
+    bool available() const {
+        return fd != -1;
+    }
+
+    std::uint64_t read() const {
+        std::uint64_t value = 0;
+        if (fd == -1 || ::read(fd, &value, sizeof(value)) != sizeof(value)) return 0;
+        return value;
+    }
+
+    ~perf_counter() {
+        if (fd != -1) close(fd);
+    }
+};
+
+/**
+ * Returns the CPU time used so far by all the threads of the process, in
+ * seconds.
+ */
+inline double process_cpu_seconds() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+#endif
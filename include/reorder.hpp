@@ -0,0 +1,188 @@
+#ifndef DISTSIM_REORDER_HPP
+#define DISTSIM_REORDER_HPP
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "common.hpp"
+#include "parallel.hpp"
+#include "rng.hpp"
+
+/**
+ * Nodes by decreasing degree (then by id), so that the hubs, which most
+ * messages go through, share cache lines.
+ *
+ * This and the following orders are meant to place neighbours close to each
+ * other in memory when nodes are laid out in that order. They take a graph
+ * in CSR form (csr_graph or mapped_graph) and return order, with order[i]
+ * the node that goes in position i.
+ */
+template<typename Graph>
+std::vector<node_id_t> degree_order(const Graph& graph) {
+    std::uint64_t nodes = graph.nodes();
+    std::uint64_t max_degree = 0;
+    for (std::uint64_t n=0; n<nodes; n++) max_degree = std::max(max_degree, graph.degree(n));
+    // Counting sort, starting from the largest degree.
+    std::vector<std::uint64_t> first(max_degree+2);
+    for (std::uint64_t n=0; n<nodes; n++) first[max_degree - graph.degree(n) + 1]++;
+    for (std::uint64_t d=1; d<first.size(); d++) first[d] += first[d-1];
+    std::vector<node_id_t> order(nodes);
+    for (std::uint64_t n=0; n<nodes; n++) order[first[max_degree - graph.degree(n)]++] = n;
+    return order;
+}
+
+/**
+ * Reverse Cuthill-McKee: every component is visited breadth-first from a
+ * node far from its centre, taking the neighbours of each node by
+ * increasing degree, and the result is reversed. This keeps the ids of
+ * neighbours within a narrow band.
+ *
+ * Components are started from their smallest degree node not yet
+ * visited; the start is moved to a node of smallest degree in the last level
+ * of a search from it, as long as that makes the search deeper.
+ */
+template<typename Graph>
+std::vector<node_id_t> rcm_order(const Graph& graph) {
+    std::uint64_t nodes = graph.nodes();
+    std::vector<node_id_t> order;
+    order.reserve(nodes);
+    std::vector<node_id_t> by_degree = degree_order(graph);
+    std::reverse(by_degree.begin(), by_degree.end());
+    std::vector<bool> visited(nodes);
+    // Levels of the searches for the start, tagged with the search they
+    // belong to so that they need not be cleared.
+    std::vector<std::uint64_t> seen(nodes, ~0ULL);
+    std::uint64_t searches = 0;
+    std::vector<node_id_t> queue;
+    auto last_level = [&] (node_id_t start, std::uint64_t& depth) {
+        std::uint64_t tag = searches++;
+        queue.assign(1, start);
+        seen[start] = tag;
+        std::size_t level_start = 0;
+        depth = 0;
+        while (true) {
+            std::size_t level_end = queue.size();
+            for (std::size_t q=level_start; q<level_end; q++) {
+                for (auto t=graph.neighbours_begin(queue[q]); t!=graph.neighbours_end(queue[q]); t++) {
+                    if (seen[*t] == tag) continue;
+                    seen[*t] = tag;
+                    queue.push_back(*t);
+                }
+            }
+            if (queue.size() == level_end) break;
+            level_start = level_end;
+            depth++;
+        }
+        node_id_t best = queue[level_start];
+        for (std::size_t q=level_start; q<queue.size(); q++)
+            if (graph.degree(queue[q]) < graph.degree(best)) best = queue[q];
+        return best;
+    };
+    std::vector<node_id_t> neighbours;
+    for (node_id_t start: by_degree) {
+        if (visited[start]) continue;
+        std::uint64_t depth, next_depth;
+        node_id_t next = last_level(start, depth);
+        for (int i=0; i<4 && next != start; i++) {
+            node_id_t far = last_level(next, next_depth);
+            if (next_depth <= depth) break;
+            start = next;
+            next = far;
+            depth = next_depth;
+        }
+        std::size_t begin = order.size();
+        order.push_back(start);
+        visited[start] = true;
+        for (std::size_t q=begin; q<order.size(); q++) {
+            neighbours.clear();
+            for (auto t=graph.neighbours_begin(order[q]); t!=graph.neighbours_end(order[q]); t++)
+                if (!visited[*t]) neighbours.push_back(*t);
+            std::sort(neighbours.begin(), neighbours.end(), [&] (node_id_t a, node_id_t b) {
+                return graph.degree(a) < graph.degree(b) || (graph.degree(a) == graph.degree(b) && a < b);
+            });
+            for (node_id_t n: neighbours) {
+                // Repeated targets are possible in graphs built without
+                // dedupe.
+                if (visited[n]) continue;
+                visited[n] = true;
+                order.push_back(n);
+            }
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+/**
+ * Nodes grouped by communities found with label propagation: every node
+ * starts in its own community and repeatedly joins the most common one
+ * among its neighbours (keeping its own on ties, and otherwise taking the
+ * smallest). Updates are synchronous, first for a pseudo-random half of the
+ * nodes and then for the other, which avoids oscillations and makes the
+ * result independent of the number of threads. Nodes in the same community
+ * keep their relative order.
+ */
+template<typename Graph>
+std::vector<node_id_t> community_order(const Graph& graph, int rounds=10, std::uint64_t seed=0, int nthreads=-1) {
+    std::uint64_t nodes = graph.nodes();
+    std::vector<node_id_t> label(nodes), next(nodes);
+    for (std::uint64_t n=0; n<nodes; n++) label[n] = n;
+    // Each half of the nodes is updated once in a round, in two steps.
+    for (int round=0, quiet=0; round<2*rounds && quiet<2; round++) {
+        std::atomic<std::uint64_t> changed{0};
+        parallel_for_ranges(nodes, 1<<14, nthreads, [&] (std::uint64_t first, std::uint64_t last) {
+            std::vector<node_id_t> labels;
+            std::uint64_t c = 0;
+            for (std::uint64_t n=first; n<last; n++) {
+                next[n] = label[n];
+                if (graph.degree(n) == 0 || (mix64(n ^ seed) & 1) != (std::uint64_t)(round & 1)) continue;
+                labels.clear();
+                for (auto t=graph.neighbours_begin(n); t!=graph.neighbours_end(n); t++) labels.push_back(label[*t]);
+                std::sort(labels.begin(), labels.end());
+                node_id_t best = label[n];
+                std::size_t best_count = std::count(labels.begin(), labels.end(), label[n]);
+                for (std::size_t i=0; i<labels.size(); ) {
+                    std::size_t j = i;
+                    while (j < labels.size() && labels[j] == labels[i]) j++;
+                    if (j - i > best_count) {
+                        best = labels[i];
+                        best_count = j - i;
+                    }
+                    i = j;
+                }
+                c += best != label[n];
+                next[n] = best;
+            }
+            changed += c;
+        });
+        label.swap(next);
+        quiet = changed ? 0 : quiet+1;
+    }
+    // Counting sort by label, stable.
+    std::vector<std::uint64_t> first(nodes+1);
+    for (std::uint64_t n=0; n<nodes; n++) first[label[n]+1]++;
+    for (std::uint64_t l=0; l<nodes; l++) first[l+1] += first[l];
+    std::vector<node_id_t> order(nodes);
+    for (std::uint64_t n=0; n<nodes; n++) order[first[label[n]]++] = n;
+    return order;
+}
+
+static const char* const node_order_names = "none, degree, rcm, community";
+
+/**
+ * Returns the order with the given name (one of node_order_names) for the
+ * graph; none is the identity.
+ */
+template<typename Graph>
+std::vector<node_id_t> node_order(const std::string& name, const Graph& graph, int nthreads=-1) {
+    if (name == "degree") return degree_order(graph);
+    if (name == "rcm") return rcm_order(graph);
+    if (name == "community") return community_order(graph, 10, 0, nthreads);
+    if (name != "none") throw std::runtime_error("Unknown node order " + name + "! Valid orders are: " + node_order_names);
+    std::vector<node_id_t> order(graph.nodes());
+    for (std::uint64_t n=0; n<order.size(); n++) order[n] = n;
+    return order;
+}
+#endif
@@ -1,6 +1,7 @@
 #ifndef DISTSIM_RNG_HPP
 #define DISTSIM_RNG_HPP
 #include <stdint.h>
+#include <limits>
 #include <vector>
 #include <algorithm>
 #include <iostream>
@@ -14,8 +15,8 @@ class xoroshiro {
     }
 public:
     typedef uint64_t result_type;
-    static result_type max() {return std::numeric_limits<uint64_t>::max();}
-    static result_type min() {return 1;}
+    static constexpr result_type max() {return std::numeric_limits<uint64_t>::max();}
+    static constexpr result_type min() {return 1;}
     xoroshiro(uint64_t s0, uint64_t s1): s0(s0), s1(s1) {}
     xoroshiro(): xoroshiro(1, 0) {}
     /**
@@ -41,14 +42,15 @@ public:
     	return (*this)(0, upper);
     }
     /**
-     * Returns up to amount distinct numbers between lower and upper (exclusive), without any number from excluded.
+     * Returns up to amount distinct numbers between lower and upper (exclusive), without any number from excluded,
+     * which must be sorted.
      */
     std::vector<uint64_t> get_distinct(uint64_t amount, uint64_t lower, uint64_t upper, const std::vector<uint64_t>& excluded = {}) {
         std::vector<uint64_t> ans;
         if (amount + lower + excluded.size() >= upper) {
             unsigned pos = 0;
             for (uint64_t i=lower; i<upper; i++) {
-                while (pos < excluded.size() && excluded[pos] <= i) pos++;
+                while (pos < excluded.size() && excluded[pos] < i) pos++;
                 if (pos < excluded.size() && excluded[pos] == i) continue;
                 ans.push_back(i);
             }
@@ -85,4 +87,79 @@ public:
 
 extern thread_local xoroshiro rng;
 
+/**
+ * Mixes the bits of x, so that close inputs give unrelated outputs
+ * (splitmix64's output function).
+ */
+inline uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * Returns a generator seeded from seed and stream, so that work split in
+ * chunks gets the same random numbers whatever the number of threads.
+ */
+inline xoroshiro seeded_rng(uint64_t seed, uint64_t stream) {
+    uint64_t x = seed ^ (stream * 0xD1B54A32D192ED03ULL);
+    uint64_t s0 = mix64(x + 0x9E3779B97F4A7C15ULL);
+    uint64_t s1 = mix64(x + 2*0x9E3779B97F4A7C15ULL);
+    return xoroshiro(s0, s1 ? s1 : 1);
+}
+
+/**
+ * A pseudo-random permutation of the numbers from 0 to n (exclusive), that
+ * can be evaluated and inverted at any point in constant expected time: a
+ * four round Feistel network on the smallest even number of bits that can
+ * hold n-1, applied again while the result is n or more.
+ */
+class random_permutation {
+    uint64_t n;
+    int half_bits;
+    uint64_t half_mask;
+    uint64_t keys[4];
+
+    uint64_t round(uint64_t x, int r) const {
+        return mix64(x ^ keys[r]) & half_mask;
+    }
+
+    uint64_t encrypt(uint64_t x) const {
+        uint64_t left = x >> half_bits, right = x & half_mask;
+        for (int r=0; r<4; r++) {
+            uint64_t next = left ^ round(right, r);
+            left = right;
+            right = next;
+        }
+        return left << half_bits | right;
+    }
+
+    uint64_t decrypt(uint64_t x) const {
+        uint64_t left = x >> half_bits, right = x & half_mask;
+        for (int r=3; r>=0; r--) {
+            uint64_t prev = right ^ round(left, r);
+            right = left;
+            left = prev;
+        }
+        return left << half_bits | right;
+    }
+public:
+    random_permutation(uint64_t n, uint64_t seed): n(n), half_bits(1) {
+        while (half_bits < 32 && (1ULL << 2*half_bits) < n) half_bits++;
+        half_mask = (1ULL << half_bits) - 1;
+        xoroshiro r = seeded_rng(seed, -1);
+        for (auto& k: keys) k = r();
+    }
+
+    uint64_t operator()(uint64_t x) const {
+        do x = encrypt(x); while (x >= n);
+        return x;
+    }
+
+    uint64_t inverse(uint64_t x) const {
+        do x = decrypt(x); while (x >= n);
+        return x;
+    }
+};
+
 #endif
@@ -0,0 +1,414 @@
+#ifndef DISTSIM_SHARDED_HWM_HPP
+#define DISTSIM_SHARDED_HWM_HPP
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "concurrentqueue.hpp"
+#include "hardware_manager.hpp"
+#include "shm_ring.hpp"
+
+/**
+ * A message on its way between two shards.
+ */
+template<typename T>
+struct shard_message {
+    node_id_t sender;
+    node_id_t receiver;
+    Message<T> msg;
+};
+
+/**
+ * The memory shared by the processes of a sharded simulation, which must be
+ * created before they are forked: a control block, the counters of every
+ * shard and a ring for every ordered pair of shards. Shard s owns the nodes
+ * from first_node(s) to first_node(s+1) (exclusive).
+ *
+ * Quiescence is detected with the four-counter method: every shard counts
+ * the messages it pushed to other shards and the ones it took from them,
+ * and says whether it is passive (its manager is idle, so that it can only
+ * get busy again by receiving a message: generators and messages can only
+ * be added before the shards run, and a generator holds pending work until
+ * it is done). The simulation is over when two
+ * consecutive reads of all the shards find them all passive, with as many
+ * messages received as sent, and the same counts both times: a message
+ * received in between would have changed them.
+ */
+template<typename T>
+class shard_group {
+public:
+    typedef spsc_ring<shard_message<T>> ring_t;
+    static_assert(std::is_trivially_copyable<Message<T>>::value, "Messages must be trivially copyable to cross processes");
+
+    struct alignas(64) shard_state {
+        std::atomic<std::uint64_t> sent{0};
+        std::atomic<std::uint64_t> received{0};
+        std::atomic<bool> passive{false};
+    };
+private:
+    struct control_block {
+        std::atomic<int> arrived{0};
+        // Set by the last shard to arrive: the origin of the clocks of all
+        // the shards, in nanoseconds of steady_clock, which is the same in
+        // every process.
+        std::atomic<long long> start_ns{0};
+        std::atomic<bool> started{false};
+        std::atomic<bool> terminated{false};
+        std::atomic<bool> aborted{false};
+    };
+
+    const int shards_;
+    const std::uint64_t nodes_;
+    const std::size_t ring_capacity;
+    std::size_t ring_bytes;
+    shared_memory memory;
+    control_block* control;
+    shard_state* states;
+
+    static std::size_t round_up(std::size_t bytes) {
+        return (bytes + 63) & ~(std::size_t)63;
+    }
+
+    static std::size_t memory_size(int shards, std::size_t ring_capacity) {
+        return round_up(sizeof(control_block)) + shards * sizeof(shard_state) +
+            (std::size_t)shards * shards * round_up(ring_t::bytes(ring_capacity));
+    }
+
+    /**
+     * Reads the counters of all the shards, returning true if they are all
+     * passive.
+     */
+    bool wave(std::vector<std::uint64_t>& sent, std::vector<std::uint64_t>& received) const {
+        bool passive = true;
+        sent.resize(shards_);
+        received.resize(shards_);
+        for (int s=0; s<shards_; s++) {
+            passive &= states[s].passive.load();
+            sent[s] = states[s].sent.load();
+            received[s] = states[s].received.load();
+        }
+        return passive;
+    }
+public:
+    shard_group(const shard_group&) = delete;
+    shard_group& operator=(const shard_group&) = delete;
+
+    /**
+     * Creates the shared memory for the given number of shards of a
+     * simulation of the given number of nodes, with rings of ring_capacity
+     * messages (a power of two).
+     */
+    shard_group(int shards, std::uint64_t nodes, std::size_t ring_capacity = 1<<14):
+        shards_(shards), nodes_(nodes), ring_capacity(ring_capacity),
+        ring_bytes(round_up(ring_t::bytes(ring_capacity))), memory(memory_size(shards, ring_capacity)) {
+        if (shards <= 0) throw std::runtime_error("There must be at least a shard");
+        if (nodes == 0) throw std::runtime_error("There must be at least a node");
+        char* base = (char*)memory.data();
+        control = new (base) control_block;
+        base += round_up(sizeof(control_block));
+        states = (shard_state*)base;
+        for (int s=0; s<shards; s++) new (&states[s]) shard_state;
+        base += shards * sizeof(shard_state);
+        for (int i=0; i<shards*shards; i++) ring_t::create(base + i * ring_bytes, ring_capacity);
+    }
+
+    int shards() const {
+        return shards_;
+    }
+
+    std::uint64_t nodes() const {
+        return nodes_;
+    }
+
+    /**
+     * Returns the shard that owns a node.
+     */
+    int owner(node_id_t node) const {
+        return (unsigned __int128)node * shards_ / nodes_;
+    }
+
+    /**
+     * Returns the first node owned by a shard, or the number of nodes for
+     * shard shards().
+     */
+    node_id_t first_node(int shard) const {
+        return ((unsigned __int128)shard * nodes_ + shards_ - 1) / shards_;
+    }
+
+    /**
+     * Returns the ring from one shard to another.
+     */
+    ring_t& ring(int from, int to) {
+        char* base = (char*)memory.data() + round_up(sizeof(control_block)) + shards_ * sizeof(shard_state);
+        return *(ring_t*)(base + ((std::size_t)from * shards_ + to) * ring_bytes);
+    }
+
+    shard_state& state(int shard) {
+        return states[shard];
+    }
+
+    /**
+     * Waits until all the shards have called this, and returns the time at
+     * which the last one did, which is the same for all of them.
+     */
+    std::chrono::steady_clock::time_point arrive_and_wait() {
+        if (control->arrived.fetch_add(1) + 1 == shards_) {
+            control->start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            control->started = true;
+        }
+        while (!control->started && !control->aborted)
+            std::this_thread::sleep_for(std::chrono::microseconds(10));
+        return std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::nanoseconds(control->start_ns.load())));
+    }
+
+    /**
+     * Returns true if no shard has work left and no message is on its way
+     * between shards; see the class comment.
+     */
+    bool quiescent() const {
+        std::vector<std::uint64_t> sent1, received1, sent2, received2;
+        if (!wave(sent1, received1)) return false;
+        std::uint64_t total_sent = 0, total_received = 0;
+        for (int s=0; s<shards_; s++) {
+            total_sent += sent1[s];
+            total_received += received1[s];
+        }
+        if (total_sent != total_received) return false;
+        return wave(sent2, received2) && sent1 == sent2 && received1 == received2;
+    }
+
+    /**
+     * Marks the simulation as over, which makes all the shards return from
+     * run_until_quiescent.
+     */
+    void terminate() {
+        control->terminated = true;
+    }
+
+    bool terminated() const {
+        return control->terminated;
+    }
+
+    /**
+     * Makes all the shards give up, for example when one of them died.
+     */
+    void abort() {
+        control->aborted = true;
+    }
+
+    bool aborted() const {
+        return control->aborted;
+    }
+};
+
+/**
+ * A hardware manager that runs the nodes of one shard of a simulation
+ * split across processes, on a graph in CSR form (csr_graph or
+ * mapped_graph) that every process has: nodes can only send messages to
+ * their neighbours, and messages to nodes of other shards are forwarded
+ * through the rings of a shard_group.
+ *
+ * Messages to other shards are queued by the workers and moved to the rings
+ * by a transport thread, which is the only producer and consumer of the
+ * rings of its shard; it also delivers the messages that arrive, after the
+ * delay of their link, counted from their arrival. The clocks of all the
+ * shards start at the same time, when the last one is ready, so that their
+ * generators and timers follow the same time.
+ */
+template<typename T, typename Graph>
+class ShardedHardwareManager: public HardwareManager<T> {
+    shard_group<T>& group;
+    const int shard;
+    const Graph& graph;
+
+    moodycamel::ConcurrentQueue<shard_message<T>> outbox;
+    std::thread transport;
+    std::atomic<bool> transport_stop{false};
+
+    /**
+     * Moves messages between the outbox, the rings and the mailboxes until
+     * stopped. Messages wait in a backlog while the ring to their shard is
+     * full, so that incoming messages are never blocked by outgoing ones,
+     * and a full backpressure mailbox drops an incoming message rather than
+     * stall the other ones.
+     */
+    void transport_loop() {
+        static const int batch_size = 256;
+        this->epochs.register_thread();
+        int shards = group.shards();
+        auto& state = group.state(shard);
+        std::vector<std::deque<shard_message<T>>> backlog(shards);
+        shard_message<T> record;
+        while (!transport_stop) {
+            bool busy = false;
+            for (int from=0; from<shards; from++) {
+                if (from == shard) continue;
+                auto& ring = group.ring(from, shard);
+                for (int i=0; i<batch_size && ring.try_pop(record); i++) {
+                    // Not passive anymore before the message is counted.
+                    state.passive = false;
+                    this->deliver(record.receiver, record.msg, false);
+                    state.received++;
+                    busy = true;
+                }
+            }
+            for (int i=0; i<batch_size && outbox.try_dequeue(record); i++)
+                backlog[group.owner(record.receiver)].push_back(record);
+            for (int to=0; to<shards; to++) {
+                auto& ring = group.ring(shard, to);
+                while (!backlog[to].empty() && ring.try_push(backlog[to].front())) {
+                    backlog[to].pop_front();
+                    state.sent++;
+                    this->work_done();
+                    busy = true;
+                }
+            }
+            if (!busy) {
+                if (this->idle()) state.passive = true;
+                std::this_thread::sleep_for(std::chrono::microseconds(1));
+            }
+            this->epochs.reclaim();
+        }
+        this->epochs.unregister_thread();
+    }
+protected:
+    bool is_remote(node_id_t node) const override {
+        return node < graph.nodes() && group.owner(node) != shard;
+    }
+
+    /**
+     * Queues the message for the transport thread. It counts as pending work
+     * until it is in a ring.
+     */
+    void forward(node_id_t sender, node_id_t receiver, Message<T> msg) override {
+        this->add_work();
+        outbox.enqueue(shard_message<T>{sender, receiver, std::move(msg)});
+    }
+public:
+    ShardedHardwareManager(shard_group<T>& group, int shard, const Graph& graph, int nt, std::uint64_t seed):
+        HardwareManager<T>(graph.nodes(), nt, seed), group(group), shard(shard), graph(graph) {
+        if (graph.nodes() != group.nodes()) throw std::runtime_error("The graph does not match the shards");
+        if (shard < 0 || shard >= group.shards()) throw std::runtime_error("Invalid shard");
+    }
+
+    /**
+     * Returns the first node of this shard.
+     */
+    node_id_t first_node() const {
+        return group.first_node(shard);
+    }
+
+    /**
+     * Returns the node after the last one of this shard.
+     */
+    node_id_t last_node() const {
+        return group.first_node(shard + 1);
+    }
+
+    bool can_send(node_id_t a, node_id_t b) const override {
+        return a < graph.nodes() && std::binary_search(graph.neighbours_begin(a), graph.neighbours_end(a), b);
+    }
+
+    void iter_neighbours(node_id_t n, const std::function<bool(node_id_t)>& callback) const override {
+        if (n >= graph.nodes()) throw std::runtime_error("Invalid node");
+        for (auto t=graph.neighbours_begin(n); t!=graph.neighbours_end(n); t++)
+            if (!callback(*t)) break;
+    }
+
+    std::size_t count_neighbours(node_id_t n) const override {
+        if (n >= graph.nodes()) throw std::runtime_error("Invalid node");
+        return graph.degree(n);
+    }
+
+    /**
+     * Returns a random node of this shard.
+     */
+    node_id_t get_random_node() override {
+        if (this->size() == 0) throw std::runtime_error("Empty node list");
+        node_id_t id = first_node() + rng() % (last_node() - first_node());
+        while (!this->has_node(id)) id = first_node() + rng() % (last_node() - first_node());
+        return id;
+    }
+
+    /**
+     * Adds a node of this shard.
+     */
+    template<typename node_t, typename... Args>
+    void add_node(node_id_t id, Args... args) {
+        if (id >= graph.nodes() || group.owner(id) != shard) throw std::runtime_error("The node belongs to another shard");
+        HardwareManager<T>::template add_node<node_t>(id, args...);
+    }
+
+    /**
+     * Registers an event generator. This must happen before
+     * run_until_quiescent, as a generator added to a passive shard would
+     * make it active without a message; the generator must also end, by
+     * reaching its limit, for the simulation to become quiescent.
+     */
+    template<typename gen_t, typename... Args>
+    gen_t& add_generator(Args&&... args) {
+        if (this->is_running()) throw std::runtime_error("Generators must be added before the shards run");
+        return HardwareManager<T>::template add_generator<gen_t>(std::forward<Args>(args)...);
+    }
+
+    /**
+     * Generates a message at a node of this shard, before
+     * run_until_quiescent for the same reason as add_generator.
+     */
+    void gen_message(node_id_t sender, const T& data = T{}) {
+        if (this->is_running()) throw std::runtime_error("Messages must be generated before the shards run");
+        HardwareManager<T>::gen_message(sender, data);
+    }
+
+    /**
+     * Waits for all the shards to be ready, starts the clock shared by all
+     * of them, the workers and the transport, and blocks until the
+     * simulation is quiescent in all the shards, which shard 0 checks.
+     * Returns false if the shards were aborted.
+     */
+    bool run_until_quiescent() {
+        this->set_clock_start(group.arrive_and_wait());
+        this->run();
+        transport = std::thread([this] () {transport_loop();});
+        while (!group.terminated() && !group.aborted()) {
+            if (shard == 0 && group.quiescent()) group.terminate();
+            else std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        return !group.aborted();
+    }
+
+    /**
+     * Stops the transport and the workers.
+     */
+    void stop() {
+        transport_stop = true;
+        if (transport.joinable()) transport.join();
+        HardwareManager<T>::stop();
+    }
+
+    /**
+     * Returns the number of messages this shard sent to other shards.
+     */
+    std::uint64_t forwarded_messages() {
+        return group.state(shard).sent;
+    }
+
+    /**
+     * Returns the number of messages this shard received from other shards.
+     */
+    std::uint64_t received_messages() {
+        return group.state(shard).received;
+    }
+
+    ~ShardedHardwareManager() {
+        transport_stop = true;
+        if (transport.joinable()) transport.join();
+    }
+};
+#endif
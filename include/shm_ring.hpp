@@ -0,0 +1,130 @@
+#ifndef DISTSIM_SHM_RING_HPP
+#define DISTSIM_SHM_RING_HPP
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <type_traits>
+
+/**
+ * A region of memory shared with the processes forked after its creation,
+ * at the same address in all of them. It is unmapped by the destructor in
+ * every process that still has it.
+ */
+class shared_memory {
+    void* addr;
+    std::size_t size_;
+public:
+    shared_memory(const shared_memory&) = delete;
+    shared_memory& operator=(const shared_memory&) = delete;
+
+    explicit shared_memory(std::size_t size): size_(size) {
+        addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED) throw std::runtime_error("Could not map shared memory");
+    }
+
+    void* data() const {
+        return addr;
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    ~shared_memory() {
+        munmap(addr, size_);
+    }
+};
+
+/**
+ * A bounded queue of trivially copyable values, with a single producer and
+ * a single consumer that can be in different processes: it only holds
+ * indexes, so it can be placed in shared memory (see create), and it is
+ * lock-free, so a process that dies cannot block the other one.
+ *
+ * The producer and the consumer each keep the last index they read of the
+ * other, on their own cache line, and only read the shared one again when
+ * the queue looks full or empty.
+ */
+template<typename V>
+class spsc_ring {
+    static_assert(std::is_trivially_copyable<V>::value, "Values must be trivially copyable");
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Indexes must be lock-free");
+
+    std::uint64_t mask;
+    alignas(64) std::atomic<std::uint64_t> head{0};
+    std::uint64_t tail_seen = 0;
+    alignas(64) std::atomic<std::uint64_t> tail{0};
+    std::uint64_t head_seen = 0;
+
+    // The values follow the ring, whose size is a multiple of 64 bytes.
+    V* slots() {
+        return reinterpret_cast<V*>(reinterpret_cast<char*>(this) + sizeof(spsc_ring));
+    }
+
+    explicit spsc_ring(std::size_t capacity): mask(capacity - 1) {}
+public:
+    spsc_ring(const spsc_ring&) = delete;
+    spsc_ring& operator=(const spsc_ring&) = delete;
+
+    /**
+     * Returns the bytes taken by a ring with the given capacity, which must
+     * be a power of two.
+     */
+    static std::size_t bytes(std::size_t capacity) {
+        return sizeof(spsc_ring) + capacity * sizeof(V);
+    }
+
+    /**
+     * Creates a ring with the given capacity in memory (such as a
+     * shared_memory) of at least bytes(capacity) bytes, aligned to 64 bytes.
+     */
+    static spsc_ring* create(void* memory, std::size_t capacity) {
+        if (capacity == 0 || (capacity & (capacity - 1)))
+            throw std::runtime_error("The capacity of a ring must be a power of two");
+        static_assert(alignof(V) <= 64, "Values are aligned to 64 bytes at most");
+        return new (memory) spsc_ring(capacity);
+    }
+
+    /**
+     * Appends a value, returning false if the ring is full. Only called by
+     * the producer.
+     */
+    bool try_push(const V& value) {
+        std::uint64_t t = tail.load(std::memory_order_relaxed);
+        if (t - head_seen > mask) {
+            head_seen = head.load(std::memory_order_acquire);
+            if (t - head_seen > mask) return false;
+        }
+        std::memcpy(&slots()[t & mask], &value, sizeof(V));
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Takes the oldest value, returning false if the ring is empty. Only
+     * called by the consumer.
+     */
+    bool try_pop(V& value) {
+        std::uint64_t h = head.load(std::memory_order_relaxed);
+        if (h == tail_seen) {
+            tail_seen = tail.load(std::memory_order_acquire);
+            if (h == tail_seen) return false;
+        }
+        std::memcpy(&value, &slots()[h & mask], sizeof(V));
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Returns true if the ring has no values. It is exact for the consumer
+     * and a hint for others.
+     */
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+};
+#endif
@@ -0,0 +1,204 @@
+#ifndef DISTSIM_SMALL_SET_HPP
+#define DISTSIM_SMALL_SET_HPP
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <vector>
+#include "cuckoo.hpp"
+
+/**
+ * A set that keeps up to inline_capacity keys in the object itself, and
+ * switches to a cuckoo_hash_set, stored in the same space, when it grows
+ * past that. Meant for the adjacency of graphs in which most nodes have few
+ * neighbours: small sets need no table of their own and are looked up
+ * without following a pointer, and the default capacity makes the whole
+ * object 64 bytes.
+ *
+ * Once the keys are in the hash set, they are moved back inline only when
+ * the size drops to half the inline capacity, so that a set whose size
+ * oscillates around the threshold is not converted at every change.
+ */
+template<typename T, T missing = (T)-1, int inline_capacity = (64 - sizeof(uint64_t))/sizeof(T)>
+class small_set {
+    static_assert(std::is_trivially_copyable<T>::value, "small_set keys must be trivially copyable");
+public:
+    typedef T value_type;
+    typedef const value_type& const_reference;
+    typedef const value_type* const_pointer;
+    typedef std::ptrdiff_t difference_type;
+    typedef size_t size_type;
+    typedef cuckoo_hash_set<T, missing> large_set_t;
+    static constexpr size_type inline_size = inline_capacity;
+private:
+    // Unused inline slots hold missing, so that lookups can compare all of
+    // them without branching on the size.
+    union {
+        T items[inline_capacity];
+        large_set_t large;
+    };
+    // The number of inline keys, or inline_capacity+1 if the keys are in
+    // the hash set.
+    uint32_t sz;
+
+    void to_large() {
+        T keys[inline_capacity];
+        std::copy(items, items+sz, keys);
+        new (&large) large_set_t;
+        large.insert_many(keys, sz);
+        sz = inline_capacity+1;
+    }
+
+    void to_inline() {
+        T keys[inline_capacity];
+        uint32_t n = 0;
+        for (const auto& k: large) keys[n++] = k;
+        large.~large_set_t();
+        std::fill(std::copy(keys, keys+n, items), items+inline_capacity, missing);
+        sz = n;
+    }
+public:
+    class const_iterator {
+    public:
+        typedef small_set::value_type value_type;
+        typedef small_set::const_reference const_reference;
+        typedef small_set::const_pointer const_pointer;
+        typedef small_set::difference_type difference_type;
+        typedef std::forward_iterator_tag iterator_category;
+    private:
+        const_pointer ptr;
+        std::optional<typename large_set_t::const_iterator> it;
+    public:
+        const_iterator(const_pointer ptr): ptr(ptr) {}
+        const_iterator(typename large_set_t::const_iterator it): ptr(nullptr), it(it) {}
+
+        bool operator==(const const_iterator& other) const {
+            return it ? *it == *other.it : ptr == other.ptr;
+        }
+        bool operator!=(const const_iterator& other) const {
+            return !(*this == other);
+        }
+
+        const_iterator& operator++() {
+            if (it) ++*it;
+            else ++ptr;
+            return *this;
+        }
+        const_iterator operator++(int) {
+            const_iterator tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        const_reference operator*() const {
+            return it ? **it : *ptr;
+        }
+    };
+
+    typedef const_iterator iterator;
+
+    small_set& operator=(const small_set& other) = delete;
+
+    small_set(): sz(0) {
+        std::fill(items, items+inline_capacity, missing);
+    }
+
+    small_set(const small_set& other): sz(other.sz) {
+        if (other.is_inline()) std::copy(other.items, other.items+inline_capacity, items);
+        else new (&large) large_set_t(other.large);
+    }
+
+    ~small_set() {
+        if (!is_inline()) large.~large_set_t();
+    }
+
+    const_iterator begin() const {
+        if (is_inline()) return const_iterator(items);
+        return const_iterator(large.begin());
+    }
+    const_iterator end() const {
+        if (is_inline()) return const_iterator(items+sz);
+        return const_iterator(large.end());
+    }
+
+    /**
+     * Returns true if the keys are stored in the object itself.
+     */
+    bool is_inline() const {
+        return sz <= inline_capacity;
+    }
+
+    bool count(const value_type& k) const {
+        if (!is_inline()) return large.count(k);
+        bool found = false;
+        for (int i=0; i<inline_capacity; i++)
+            found |= items[i] == k;
+        return found;
+    }
+
+    void insert(value_type k) {
+        if (!is_inline()) {
+            large.insert(k);
+            return;
+        }
+        if (count(k)) return;
+        if (sz == inline_capacity) {
+            to_large();
+            large.insert(k);
+            return;
+        }
+        items[sz++] = k;
+    }
+
+    /**
+     * Inserts n keys at once, switching to the hash set only once if they
+     * do not fit inline.
+     */
+    void insert_many(const value_type* keys, size_type n) {
+        if (is_inline() && sz+n > inline_capacity) {
+            size_type i = 0;
+            for (; i<n && sz<inline_capacity; i++) insert(keys[i]);
+            if (i == n) return;
+            to_large();
+            keys += i;
+            n -= i;
+        }
+        if (!is_inline()) {
+            large.insert_many(keys, n);
+            return;
+        }
+        for (size_type i=0; i<n; i++) insert(keys[i]);
+    }
+
+    void insert_many(const std::vector<value_type>& keys) {
+        insert_many(keys.data(), keys.size());
+    }
+
+    void erase(const value_type& k) {
+        if (!is_inline()) {
+            large.erase(k);
+            if (large.size() <= inline_capacity/2) to_inline();
+            return;
+        }
+        for (uint32_t i=0; i<sz; i++)
+            if (items[i] == k) {
+                items[i] = items[--sz];
+                items[sz] = missing;
+                return;
+            }
+    }
+
+    size_type size() const {
+        return is_inline() ? sz : large.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    void clear() {
+        if (!is_inline()) large.~large_set_t();
+        std::fill(items, items+inline_capacity, missing);
+        sz = 0;
+    }
+};
+#endif
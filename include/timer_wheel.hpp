@@ -0,0 +1,145 @@
+#ifndef DISTSIM_TIMER_WHEEL_HPP
+#define DISTSIM_TIMER_WHEEL_HPP
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "concurrentqueue.hpp"
+#include "common.hpp"
+
+/**
+ * A single pending timer.
+ */
+struct timer_entry {
+    node_id_t node;
+    std::uint64_t token;
+    std::uint64_t expiry;
+};
+
+/**
+ * Hierarchical timing wheel shared by all the nodes of a manager.
+ *
+ * Time is measured in ticks. There are 4 levels of 256 slots each, level l
+ * holding the timers whose expiry differs from the current tick only in the
+ * lowest 8*(l+1) bits; timers further in the future wait in an overflow list.
+ * Scheduling and expiring a timer cost O(1) amortized, independently of the
+ * number of pending timers.
+ *
+ * schedule can be called concurrently from any thread: new timers go through
+ * a lock-free queue and are only moved into the wheel by the thread that
+ * advances it, which is the only one touching the slots.
+ */
+class TimerWheel {
+    static const int levels = 4;
+    static const int slot_bits = 8;
+    static const int slots = 1 << slot_bits;
+
+    moodycamel::ConcurrentQueue<timer_entry> incoming;
+    std::atomic<bool> advancing{false};
+    std::atomic<std::uint64_t> pending_{0};
+
+    std::uint64_t now_ = 0;
+    std::array<std::array<std::vector<timer_entry>, slots>, levels> wheel;
+    // One bit per slot, set if the slot is not empty.
+    std::array<std::array<std::uint64_t, slots/64>, levels> occupied{};
+    std::vector<timer_entry> overflow;
+
+    template<typename F>
+    void place(timer_entry e, F& expired) {
+        if (e.expiry <= now_) {
+            expired(e);
+            return;
+        }
+        int level = (63 - __builtin_clzll(e.expiry ^ now_)) / slot_bits;
+        if (level >= levels) {
+            overflow.push_back(e);
+            return;
+        }
+        int slot = (e.expiry >> (slot_bits*level)) & (slots-1);
+        wheel[level][slot].push_back(e);
+        occupied[level][slot/64] |= 1ULL << (slot%64);
+    }
+
+    /**
+     * Returns the first non-empty slot of level 0 starting from from, or
+     * slots if there is none.
+     */
+    int next_occupied(int from) const {
+        for (int w = from/64; w < slots/64; w++) {
+            std::uint64_t bits = occupied[0][w];
+            if (w == from/64) bits &= ~0ULL << (from%64);
+            if (bits) return w*64 + __builtin_ctzll(bits);
+        }
+        return slots;
+    }
+
+    template<typename F>
+    void take(int level, int slot, F&& fun) {
+        occupied[level][slot/64] &= ~(1ULL << (slot%64));
+        std::vector<timer_entry> entries;
+        std::swap(entries, wheel[level][slot]);
+        for (const auto& e: entries) fun(e);
+    }
+
+    /**
+     * Moves the timers of the higher levels that are now close enough to
+     * the lower ones. Called when now_ crosses a multiple of slots.
+     */
+    template<typename F>
+    void cascade(F& expired) {
+        for (int level = 1; level < levels; level++) {
+            int slot = (now_ >> (slot_bits*level)) & (slots-1);
+            take(level, slot, [&] (const timer_entry& e) {place(e, expired);});
+            if (slot != 0) return;
+        }
+        std::vector<timer_entry> far;
+        std::swap(far, overflow);
+        for (const auto& e: far) place(e, expired);
+    }
+public:
+    /**
+     * Schedules a timer. Thread safe.
+     */
+    void schedule(const timer_entry& e) {
+        pending_++;
+        incoming.enqueue(e);
+    }
+
+    /**
+     * Returns the number of timers that were scheduled and did not expire yet.
+     */
+    std::uint64_t pending() const {
+        return pending_;
+    }
+
+    /**
+     * Advances the wheel up to the given tick, calling expired on every timer
+     * that expires. If another thread is already advancing the wheel, it
+     * returns false immediately.
+     */
+    template<typename F>
+    bool advance(std::uint64_t target, F&& expired) {
+        if (advancing.exchange(true, std::memory_order_acquire)) return false;
+        auto expire = [&] (const timer_entry& e) {
+            pending_--;
+            expired(e);
+        };
+        timer_entry e;
+        while (incoming.try_dequeue(e)) place(e, expire);
+        while (now_ < target) {
+            int slot = next_occupied((now_ & (slots-1)) + 1);
+            std::uint64_t t = (now_ & ~(std::uint64_t)(slots-1)) + slot;
+            if (t > target) {
+                now_ = target;
+                break;
+            }
+            now_ = t;
+            if ((now_ & (slots-1)) == 0) cascade(expire);
+            take(0, now_ & (slots-1), expire);
+        }
+        advancing.store(false, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef DISTSIM_TINYCOIN_HPP
 #define DISTSIM_TINYCOIN_HPP
 #include "common.hpp"
+#include "cuckoo_map.hpp"
 #include "node.hpp"
 #include <atomic>
 #include <vector>
@@ -12,6 +13,7 @@
 
 struct TinyTransaction {
     static std::chrono::nanoseconds delay;
+    static std::size_t size;
     static std::size_t next_id() {
         static std::atomic<std::size_t> n{1};
         return n++;
@@ -32,6 +34,7 @@ struct TinyTransaction {
 struct TinyBlock {
     static std::chrono::nanoseconds delay_per_transaction;
     static std::chrono::nanoseconds base_delay;
+    static std::size_t header_size;
     static std::size_t next_id() {
         static std::atomic<std::size_t> n{1};
         return n++;
@@ -47,39 +50,49 @@ struct TinyBlock {
     std::chrono::nanoseconds delay() const {
         return transactions->size()*delay_per_transaction+base_delay;
     }
+    std::size_t size() const {
+        return header_size + transactions->size()*TinyTransaction::size;
+    }
 };
 
 using TinyData = std::variant<TinyTransaction, TinyBlock>;
 
 class TinyNode: public Node<TinyData> {
 protected:
-    std::vector<TinyBlock> blockchain{1, {0, (node_id_t)-1}};
-    std::vector<std::vector<TinyBlock>> pending_blocks;
+    // Blocks are indexed by their global id, but every node takes one for
+    // its genesis block, and only few blocks are pending at any time: sparse
+    // maps keep these indexes proportional to what the node holds.
+    cuckoo_hash_map<std::size_t, TinyBlock> blockchain;
+    cuckoo_hash_map<std::size_t, std::vector<TinyBlock>> pending_blocks;
     std::vector<TinyTransaction> received_transactions;
-    std::vector<std::size_t> lengths{1, 0};
+    cuckoo_hash_map<std::size_t, std::size_t> lengths;
     std::mutex transaction_mutex;
     std::mutex blockchain_mutex;
     size_t head = 0;
     double balance;
 
     /**
-     * Sets the data of a message, changing the delay to the correct value.
+     * Sets the data of a message, changing the delay and the size to the
+     * correct values.
      *
      * Transaction overload.
      */
     void set_data(Message<TinyData>& msg, const TinyTransaction& tx) {
         msg.data(TinyData{tx});
         msg.delay(TinyTransaction::delay);
+        msg.size(TinyTransaction::size);
     }
 
     /**
-     * Sets the data of a message, changing the delay to the correct value.
+     * Sets the data of a message, changing the delay and the size to the
+     * correct values.
      *
      * Block overload.
      */
     void set_data(Message<TinyData>& msg, const TinyBlock& blk) {
         msg.data(TinyData{blk});
         msg.delay(blk.delay());
+        msg.size(blk.size());
     }
 
     /**
@@ -118,12 +131,12 @@ protected:
     void update_head(size_t new_head) {
         size_t old_head = head;
         head = new_head;
-        for (; lengths[new_head] > lengths[old_head]; new_head = blockchain[new_head].parent) {
-            confirm(blockchain[new_head]);
+        for (; lengths.at(new_head) > lengths.at(old_head); new_head = blockchain.at(new_head).parent) {
+            confirm(blockchain.at(new_head));
         }
-        for (; new_head != old_head; new_head = blockchain[new_head].parent, old_head = blockchain[old_head].parent) {
-            confirm(blockchain[new_head]);
-            unconfirm(blockchain[old_head]);
+        for (; new_head != old_head; new_head = blockchain.at(new_head).parent, old_head = blockchain.at(old_head).parent) {
+            confirm(blockchain.at(new_head));
+            unconfirm(blockchain.at(old_head));
         }
     }
 
@@ -136,30 +149,28 @@ protected:
         std::vector<TinyBlock> fwd;
         {
             std::lock_guard<std::mutex> blockchain_lock(blockchain_mutex);
+            const TinyBlock* known = blockchain.find(block.id);
             // If I have already seen this block, I should not forward it.
-            if (satisfies<TinyBlock>(blockchain, block.id, [&](const TinyBlock& blk) {
-                return blk.id != (std::size_t)-1;
-            })) should_forward = false;
+            if (known != nullptr) should_forward = false;
 
             // If I have already handled this block, do nothing.
-            if (satisfies<TinyBlock>(blockchain, block.id, [&](const TinyBlock& blk) {
-                return blk.id == block.id;
-            })) return should_forward;
+            if (known != nullptr && known->id == block.id) return should_forward;
 
-            vec_set(blockchain, block.id, block);
-            if (pending_blocks.size() <= block.id) pending_blocks.resize(block.id+1);
+            blockchain[block.id] = block;
             // If I have not handled the parent of this block yet, enqueue the block and
             // do nothing.
-            if (satisfies<TinyBlock>(blockchain, block.parent, [&](const TinyBlock& blk) {
-                return blk.id == (std::size_t)-1 || blk.id == (std::size_t)-2;
-            })) {
+            const TinyBlock* parent = blockchain.find(block.parent);
+            if (parent == nullptr || parent->id == (std::size_t)-2) {
                 blockchain[block.id].id = -2;
                 pending_blocks[block.parent].push_back(block);
                 return should_forward;
             }
-            vec_set(lengths, block.id, lengths[block.parent]+1);
-            if (lengths[block.id] > lengths[head]) update_head(block.id);
-            std::swap(fwd, pending_blocks[block.id]);
+            lengths[block.id] = lengths.at(block.parent)+1;
+            if (lengths.at(block.id) > lengths.at(head)) update_head(block.id);
+            if (std::vector<TinyBlock>* children = pending_blocks.find(block.id)) {
+                std::swap(fwd, *children);
+                pending_blocks.erase(block.id);
+            }
         }
         // Handle children of this block
         for (auto chld: fwd) handle_block(chld);
@@ -227,7 +238,10 @@ public:
      * Constructor.
      */
     TinyNode(HardwareManager<TinyData>* manager, node_id_t id):
-        Node(manager, id), balance(rng() % 1024 + 16) {}
+        Node(manager, id), balance(rng() % 1024 + 16) {
+        blockchain.insert(0, {0, (node_id_t)-1});
+        lengths.insert(0, 1);
+    }
     virtual ~TinyNode() = default;
 };
 
@@ -239,8 +253,8 @@ class MinerPolicy {
 protected:
     const std::vector<TinyTransaction>& transactions;
     const std::set<std::size_t>& pending_transactions;
-    const std::vector<TinyBlock>& blockchain;
-    const std::vector<std::size_t>& lengths;
+    const cuckoo_hash_map<std::size_t, TinyBlock>& blockchain;
+    const cuckoo_hash_map<std::size_t, std::size_t>& lengths;
     const std::size_t& head;
     const std::size_t id;
     const std::function<void(TinyBlock)> send_block;
@@ -263,8 +277,8 @@ public:
     MinerPolicy(
         const std::vector<TinyTransaction>& transactions,
         const std::set<std::size_t>& pending_transactions,
-        const std::vector<TinyBlock>& blockchain,
-        const std::vector<std::size_t>& lengths,
+        const cuckoo_hash_map<std::size_t, TinyBlock>& blockchain,
+        const cuckoo_hash_map<std::size_t, std::size_t>& lengths,
         const std::size_t& head,
         const std::size_t id,
         const std::function<void(TinyBlock)> send_block,
@@ -280,8 +294,8 @@ template<typename Policy, typename... Args>
 std::unique_ptr<MinerPolicy> make_policy(
     const std::vector<TinyTransaction>& transactions,
     const std::set<std::size_t>& pending_transactions,
-    const std::vector<TinyBlock>& blockchain,
-    const std::vector<std::size_t>& lengths,
+    const cuckoo_hash_map<std::size_t, TinyBlock>& blockchain,
+    const cuckoo_hash_map<std::size_t, std::size_t>& lengths,
     const std::size_t& head,
     const std::size_t id,
     const std::function<void(TinyBlock)> send_block,